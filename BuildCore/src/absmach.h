@@ -120,6 +120,7 @@ in situations where a large number of small free blocks are generated.
 #define FREETAG (-1)         /* indicates that the block is free. */
 #define TERMINATOR (-3)      /* used to terminate the fwdlink chain */
 #define LOCKEDBLOCK (-5)     /* used for the final block in freelist */
+#define PENDINGTAG (-7)      /* refcnt of an array on the free queue */
 
 /* size field */
 #define blksize(bx)   ((nialhdr*)&mem[bx])->size
@@ -378,6 +379,7 @@ extern void reserveints(nialint n);
 
 extern void deallocate_atomtbl(void);
 extern void freeit(nialptr x);
+extern void flushfree(void);
 extern nialint pickshape(nialptr x, nialint i);
 extern nialptr new_create_array(int k, int v, nialint t, nialint *extents);
 extern nialptr stackempty(void);
@@ -414,6 +416,8 @@ extern nialptr explode(nialptr x, int v, nialint t, nialint s, nialint e);
 extern nialptr implode(nialptr x);
 extern void clearstack(void);
 extern void clearheap(void);
+extern void marktemps(void);
+extern void cleartemps(void);
 
 #ifdef DEBUG
 void nabort(int flag);
@@ -443,6 +447,9 @@ extern void store_array(nialptr x, nialint i, nialptr z);
 
 extern int  equalshape(nialptr x, nialptr y);
 extern void expand_heap(nialint n);
+extern nialint trim_heap(void);
+extern nialint compact_heap(nialint * released);
+extern void autocompact(void);
 extern void setup_abstract_machine(nialint initialmemsize);
 extern void clear_abstract_machine(void);
 extern nialint *calcshpptr(nialptr x, int v);
@@ -254,6 +254,23 @@ iprofiletable,
 iGetEnv,
 icatch,
 ithrow,
+itrimheap,
+icompact,
+isetcompact,
+itonumbers,
+inumstring,
+ireadcsv,
+isetsweep,
+iinmask,
+iinter,
+iunion,
+igroup,
+igroupcount,
+igroupsum,
+igroupmin,
+igroupmax,
+igroupmean,
+isetdefscache,
 };
 
 void (*binapplytab[])() = {
@@ -296,6 +313,13 @@ b_drop,
 b_cutall,
 b_cut,
 b_up,
+b_inmask,
+b_inter,
+b_union,
+b_groupsum,
+b_groupmin,
+b_groupmax,
+b_groupmean,
 };
 
 void initprims()
@@ -535,4 +559,21 @@ init_primname("PROFILETABLE",'E');
 init_primname("GETENV",'U');
 init_primname("CATCH",'T');
 init_primname("THROW",'U');
+init_primname("TRIMHEAP",'E');
+init_primname("COMPACT",'E');
+init_primname("SETCOMPACT",'U');
+init_primname("TONUMBERS",'U');
+init_primname("NUMSTRING",'U');
+init_primname("READCSV",'U');
+init_primname("SETSWEEP",'U');
+init_primname("INMASK",'B');
+init_primname("INTER",'B');
+init_primname("UNION",'B');
+init_primname("GROUP",'U');
+init_primname("GROUPCOUNT",'U');
+init_primname("GROUPSUM",'B');
+init_primname("GROUPMIN",'B');
+init_primname("GROUPMAX",'B');
+init_primname("GROUPMEAN",'B');
+init_primname("SETDEFSCACHE",'U');
 }
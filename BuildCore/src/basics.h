@@ -279,3 +279,27 @@ extern void iprofiletable(void);
 extern void iGetEnv(void);
 extern void icatch(void);
 extern void ithrow(void);
+extern void itrimheap(void);
+extern void icompact(void);
+extern void isetcompact(void);
+extern void itonumbers(void);
+extern void inumstring(void);
+extern void ireadcsv(void);
+extern void isetsweep(void);
+extern void iinmask(void);
+extern void b_inmask(void);
+extern void iinter(void);
+extern void b_inter(void);
+extern void iunion(void);
+extern void b_union(void);
+extern void igroup(void);
+extern void igroupcount(void);
+extern void igroupsum(void);
+extern void b_groupsum(void);
+extern void igroupmin(void);
+extern void b_groupmin(void);
+extern void igroupmax(void);
+extern void b_groupmax(void);
+extern void igroupmean(void);
+extern void b_groupmean(void);
+extern void isetdefscache(void);
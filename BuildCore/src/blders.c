@@ -198,17 +198,19 @@ b_ifexpr(nialint cnt)
 }
 
  /* builder for casr expression. both vals and exprs needed for selectors
-  * tags. The vals are used in eval and the exprs in deparse */
+  * tags. The vals are used in eval and the exprs in deparse. cindex is the
+  * dispatch index built by parse, or Null if there is none. */
 
 nialptr
-b_caseexpr(nialptr ctest, nialptr selectvals, nialptr selectexprs, nialptr exprseqs)
+b_caseexpr(nialptr ctest, nialptr selectvals, nialptr selectexprs, nialptr exprseqs, nialptr cindex)
 {
   apush(createint(t_caseexpr));
   apush(ctest);
   apush(selectvals);
   apush(selectexprs);
   apush(exprseqs);
-  mklist(5);
+  apush(cindex);
+  mklist(6);
   return (apop());
 }
 
@@ -34,6 +34,9 @@
 /* STDLIB */
 #include <stdlib.h>
 
+/* STLIB */
+#include <string.h>
+
 /* SJLIB */
 #include <setjmp.h>
 
@@ -1711,6 +1714,165 @@ equal(nialptr x, nialptr y)
 }
 
 
+/* routines to compute a structural hash of an array that is consistent
+   with equal: arrays that are equal have the same hash value. The hash
+   is computed from the kind, valence, shape and the item values, so it
+   does not depend on where the array lives in the heap and remains valid
+   after a workspace is saved and reloaded. Phrases and faults are hashed
+   on their text for the same reason. The result is always non-negative.
+
+   itemhash(x,i) gives the same value as arrayhash(fetchasarray(x,i))
+   without creating the item, which lets callers hash the items of a
+   homogeneous list without allocating atoms. Neither routine frees
+   its argument. */
+
+#ifdef INTS32
+#define HASHSEED  2166136261u
+#define HASHPRIME 16777619u
+#else
+#define HASHSEED  14695981039346656037u
+#define HASHPRIME 1099511628211u
+#endif
+
+#define hashmix(h,v) (((h) ^ (unialint)(v)) * HASHPRIME)
+
+static unialint
+hashreal(unialint h, double r)
+{
+  unialint    bits[sizeof(double) / sizeof(unialint)];
+  size_t      i;
+
+  if (r == 0.)
+    r = 0.;                  /* -0. is equal to 0. */
+  memcpy(bits, &r, sizeof(double));
+  for (i = 0; i < sizeof(double) / sizeof(unialint); i++)
+    h = hashmix(h, bits[i]);
+  return h;
+}
+
+static unialint
+hashtext(unialint h, char *s, nialint n)
+{
+  nialint     i;
+
+  for (i = 0; i < n; i++)
+    h = hashmix(h, (unsigned char) s[i]);
+  return h;
+}
+
+static unialint
+hashatom(int k, unialint h)
+{
+  return hashmix(hashmix(h, k), 0);  /* kind and valence of an atom */
+}
+
+static unialint
+arrayhash1(nialptr x)
+{
+  int         k = kind(x),
+              v = valence(x);
+  unialint    h = hashmix(hashmix(HASHSEED, k), v);
+  nialint     t = tally(x),
+              i,
+             *shp = shpptr(x, v);
+
+  if (k == phrasetype || k == faulttype)
+    return hashtext(h, pfirstchar(x), tknlength(x));
+  for (i = 0; i < v; i++)
+    h = hashmix(h, shp[i]);
+  switch (k) {
+    case atype:
+        for (i = 0; i < t; i++)
+          h = hashmix(h, arrayhash1(fetch_array(x, i)));
+        break;
+    case booltype:
+        for (i = 0; i < t; i++)
+          h = hashmix(h, fetch_bool(x, i));
+        break;
+    case inttype:
+        for (i = 0; i < t; i++)
+          h = hashmix(h, fetch_int(x, i));
+        break;
+    case chartype:
+        h = hashtext(h, pfirstchar(x), t);
+        break;
+    case realtype:
+        for (i = 0; i < t; i++)
+          h = hashreal(h, fetch_real(x, i));
+        break;
+  }
+  return h;
+}
+
+nialint
+arrayhash(nialptr x)
+{
+  return (nialint) (arrayhash1(x) >> 1);
+}
+
+nialint
+itemhash(nialptr x, nialint i)
+{
+  int         k = kind(x);
+  unialint    h;
+
+  if (k == atype)
+    return arrayhash(fetch_array(x, i));
+  if (atomic(x))
+    return arrayhash(x);
+  h = hashatom(k, HASHSEED);
+  switch (k) {
+    case booltype:
+        h = hashmix(h, fetch_bool(x, i));
+        break;
+    case inttype:
+        h = hashmix(h, fetch_int(x, i));
+        break;
+    case chartype:
+        h = hashmix(h, (unsigned char) fetch_char(x, i));
+        break;
+    case realtype:
+        h = hashreal(h, fetch_real(x, i));
+        break;
+  }
+  return (nialint) (h >> 1);
+}
+
+/* routine to test whether item i of x is equal to the array y without
+   creating the item. Unlike equal it does not free y if it is a temporary. */
+
+int
+equalitem(nialptr x, nialint i, nialptr y)
+{
+  int         k = kind(x),
+              res;
+
+  if (k == atype || atomic(x)) {
+    nialptr     xi = (k == atype ? fetch_array(x, i) : x);
+
+    incrrefcnt(xi);          /* protect both from the freeups in equal */
+    incrrefcnt(y);
+    res = equal(xi, y);
+    decrrefcnt(xi);
+    decrrefcnt(y);
+    return res;
+  }
+  if (kind(y) != k || valence(y) != 0)
+    return false;
+  switch (k) {
+    case booltype:
+        return fetch_bool(x, i) == boolval(y);
+    case inttype:
+        return fetch_int(x, i) == intval(y);
+    case chartype:
+        return fetch_char(x, i) == charval(y);
+    case realtype:
+        return fetch_real(x, i) == realval(y);
+  }
+  return false;
+}
+
+
 /* routines to implement the primitive comparator : up 
    which returns the lexicographic comparison of a and b. The ordering
    is based on comparing the items. If the arrays are atomic
@@ -1907,3 +2069,243 @@ up(nialptr a, nialptr b)
   freeup(b);
   return res;
 }
+
+
+/* routines to sort a list of strings by "up" using normalised keys.
+   Comparing two strings with up maps each character through invseq and
+   orders a proper prefix first. Mapping every string once into a byte
+   key gives the same order with plain byte comparison, so a list of
+   strings can be sorted without calling up at all. The first 8 key bytes
+   are also packed into an integer so that most comparisons are decided
+   by one integer test.
+
+   The keys are only used when every item is a string (or an empty list)
+   and the characters are ones whose invseq values fit in a byte, which
+   covers the normal collating sequences; otherwise the caller falls back
+   to comparing with up. The merge sort is stable, so the order of equal
+   strings, and hence the result of GRADE, is the same as before. */
+
+typedef struct {
+  unsigned long long pre;    /* first 8 key bytes, high byte first */
+  unsigned char *key;
+  nialint     len;
+  nialint     idx;
+} strkey;
+
+#define KEYRUN 16            /* runs sorted by insertion before merging */
+
+static int
+keyorder(strkey * a, strkey * b)
+{
+  nialint     n;
+  int         c;
+
+  if (a->pre != b->pre)
+    return (a->pre < b->pre ? -1 : 1);
+  n = (a->len < b->len ? a->len : b->len);
+  if (n > 8) {
+    c = memcmp(a->key + 8, b->key + 8, n - 8);
+    if (c != 0)
+      return (c);
+  }
+  return (a->len < b->len ? -1 : a->len > b->len ? 1 : 0);
+}
+
+/* byte rank of each character under invseq, or -1 if it does not fit */
+
+static void
+keyranks(int *rank)
+{
+  int         c;
+
+  for (c = 0; c <= HIGHCHAR - LOWCHAR; c++) {
+    int         r = invseq[c];
+
+    rank[c] = (r >= 0 && r <= 255 ? r : -1);
+  }
+}
+
+/* test that item i of x is a string or empty and return its text */
+
+static int
+plainstring(nialptr x, nialint i, char **s, nialint * len)
+{
+  nialptr     it = fetch_array(x, i);
+
+  if (valence(it) != 1)
+    return (false);
+  if (tally(it) == 0) {
+    *s = "";
+    *len = 0;
+    return (true);
+  }
+  if (kind(it) != chartype)
+    return (false);
+  *s = pfirstchar(it);
+  *len = tally(it);
+  return (true);
+}
+
+/* stringsort fills the link array L of the merge sort in trs.c for the
+   list of strings x of tally n: L[0] is the 1-origin index of the first
+   item in order and L[k] the index of the item following item k.
+   It returns false, without touching L, if the keys cannot be used. */
+
+int
+stringsort(nialptr x, nialint * L, nialint n)
+{
+  int         rank[HIGHCHAR - LOWCHAR + 1];
+  strkey     *keys,
+             *tmp;
+  unsigned char *text,
+             *kp;
+  nialint     i,
+              j,
+              total = 0,
+              width;
+
+  if (kind(x) != atype || n <= 0)
+    return (false);
+  keyranks(rank);
+  for (i = 0; i < n; i++) {
+    char       *s;
+    nialint     len;
+
+    if (!plainstring(x, i, &s, &len))
+      return (false);
+    for (j = 0; j < len; j++) {
+      int         c = s[j] - LOWCHAR;
+
+      if (c < 0 || c > HIGHCHAR - LOWCHAR || rank[c] < 0)
+        return (false);
+    }
+    total += len;
+  }
+  keys = (strkey *) malloc(2 * n * sizeof(strkey));
+  text = (unsigned char *) malloc(total + 1);
+  if (keys == NULL || text == NULL) {
+    free(keys);
+    free(text);
+    return (false);
+  }
+  tmp = keys + n;
+
+  /* build the keys */
+  kp = text;
+  for (i = 0; i < n; i++) {
+    char       *s;
+    nialint     len;
+    unsigned long long pre = 0;
+
+    if (!plainstring(x, i, &s, &len)) {
+      free(keys);
+      free(text);
+      return (false);
+    }
+    for (j = 0; j < len; j++)
+      kp[j] = (unsigned char) rank[s[j] - LOWCHAR];
+    for (j = 0; j < 8; j++)
+      pre = (pre << 8) | (j < len ? kp[j] : 0);
+    keys[i].pre = pre;
+    keys[i].key = kp;
+    keys[i].len = len;
+    keys[i].idx = i;
+    kp += len;
+  }
+
+  /* insertion sort the short runs */
+  for (i = 0; i < n; i += KEYRUN) {
+    nialint     hi = (i + KEYRUN < n ? i + KEYRUN : n);
+
+    for (j = i + 1; j < hi; j++) {
+      strkey      v = keys[j];
+      nialint     k = j;
+
+      while (k > i && keyorder(&v, &keys[k - 1]) < 0) {
+        keys[k] = keys[k - 1];
+        k--;
+      }
+      keys[k] = v;
+    }
+  }
+
+  /* merge runs of doubling width, taking from the left run on ties */
+  for (width = KEYRUN; width < n; width *= 2) {
+    strkey     *t;
+
+    for (i = 0; i < n; i += 2 * width) {
+      nialint     lo = i,
+                  mid = (i + width < n ? i + width : n),
+                  hi = (i + 2 * width < n ? i + 2 * width : n),
+                  a = lo,
+                  b = mid,
+                  k = lo;
+
+      if (mid == hi || keyorder(&keys[mid - 1], &keys[mid]) <= 0) {
+        memcpy(tmp + lo, keys + lo, (hi - lo) * sizeof(strkey));
+        continue;            /* already in order */
+      }
+      while (a < mid && b < hi)
+        tmp[k++] = (keyorder(&keys[b], &keys[a]) < 0 ? keys[b++] : keys[a++]);
+      while (a < mid)
+        tmp[k++] = keys[a++];
+      while (b < hi)
+        tmp[k++] = keys[b++];
+    }
+    t = keys;
+    keys = tmp;
+    tmp = t;
+  }
+
+  /* convert to the links used by the merge sort in trs.c */
+  L[0] = keys[0].idx + 1;
+  for (i = 0; i + 1 < n; i++)
+    L[keys[i].idx + 1] = keys[i + 1].idx + 1;
+  L[keys[n - 1].idx + 1] = 0;
+  free(keys < tmp ? keys : tmp);
+  free(text);
+  return (true);
+}
+
+/* stringup and stringequal give the results of up and equal for two
+   items that are strings, without the general case analysis. They return
+   -1 if either argument is not a string, so that the caller uses up or
+   equal. Neither frees its arguments. */
+
+int
+stringup(nialptr a, nialptr b)
+{
+  char       *s,
+             *t;
+  nialint     i,
+              n,
+              la,
+              lb;
+
+  if (kind(a) != chartype || kind(b) != chartype ||
+      valence(a) != 1 || valence(b) != 1)
+    return (-1);
+  s = pfirstchar(a);
+  t = pfirstchar(b);
+  la = tally(a);
+  lb = tally(b);
+  n = (la < lb ? la : lb);
+  for (i = 0; i < n; i++) {
+    int         c0 = invseq[s[i] - LOWCHAR],
+                c1 = invseq[t[i] - LOWCHAR];
+
+    if (c0 != c1)
+      return (c0 < c1);
+  }
+  return (la <= lb);
+}
+
+int
+stringequal(nialptr a, nialptr b)
+{
+  if (kind(a) != chartype || kind(b) != chartype ||
+      valence(a) != 1 || valence(b) != 1)
+    return (-1);
+  return (tally(a) == tally(b) &&
+          memcmp(pfirstchar(a), pfirstchar(b), tally(a)) == 0);
+}
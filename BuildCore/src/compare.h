@@ -16,5 +16,16 @@ extern int equal(nialptr x, nialptr y);
 extern int up(nialptr x, nialptr y);
    /* used by atops.c, trs.c */
 
+extern nialint arrayhash(nialptr x);
+extern nialint itemhash(nialptr x, nialint i);
+extern int equalitem(nialptr x, nialint i, nialptr y);
+   /* used by ntable.c */
+
+extern int stringsort(nialptr x, nialint * L, nialint n);
+   /* used by trs.c */
+
+extern int stringup(nialptr a, nialptr b);
+extern int stringequal(nialptr a, nialptr b);
+   /* used by atops.c */
 
 
@@ -88,8 +88,15 @@
 /* prototypes for local routines */
 
 static void apply_transform(nialptr tr);
-static void prologue(nialptr env, nialint nvars, nialptr * senv);
-static void epilogue(nialptr senv, nialint nvars);
+static void prologue(nialptr env, nialint nvars, nialptr * senv, nialint * ssp);
+static void epilogue(nialptr senv, nialint ssp, nialint nvars);
+static void dropframe(nialptr senv, nialint ssp, nialint nvars);
+static nialptr callform(nialptr fn, int paired, int tail);
+static void applypair(nialptr fn);
+static void applynamed(nialptr fn, int paired);
+static nialptr tailexpr(nialptr exp);
+static void restseq(nialptr exp, nialint i);
+static void holdfn(nialptr * hfn, nialptr fn);
 static void setup_env(nialptr syms, nialptr sps, nialptr * svenv);
 static void restore_env(nialptr syms, nialptr svenv);
 static void nct_throw_result(nialptr nfault, int rc_code);
@@ -115,6 +122,7 @@ static int  d_infaultbreakloop, /* signals a resume after break */
 static void dump_call_stack(void);
 static void enter_op(nialptr entr);
 static void exit_op(void);
+static void tail_op(nialptr entr);
 static void break_loop(int flag);
 static void do_watch_action(nialptr, nialptr);
 static void fault_loop(nialptr);
@@ -241,6 +249,30 @@ static int  changetrigger,
 
 #define is_systemop(op)	(tag(op)==t_variable && sym_flag(get_entry(op)))
 
+/* plaincalls is true when none of the features that watch operation
+   calls is active, so that apply can skip their bookkeeping */
+
+#ifdef PROFILE
+#define plaincalls	(!(trace || triggered || debugging_on || profile))
+#else
+#define plaincalls	(!(trace || triggered || debugging_on))
+#endif
+
+/* tailcalls is true when a call in tail position can reuse the activation
+   record while calls are being watched. Fault triggering and breakpoints
+   only need the call stack, but tracing, profiling, stepping and the
+   display of user routines see each call. */
+
+#ifdef PROFILE
+#define tailcalls	(!(trace || profile || userroutines || d_onestep || \
+                           d_stepin || d_toend || d_next))
+#else
+#define tailcalls	(!(trace || userroutines || d_onestep || d_stepin || \
+                           d_toend || d_next))
+#endif
+
+static nialptr tailentr;     /* entry of the opform returned by tailexpr */
+
 
  /* eval routine that can be called from Nial level */
 
@@ -292,6 +324,76 @@ ieval()
   decrrefcnt(current_env);
 }
 
+/* routines used by a FOR loop to step through the addresses given by
+   tell N or grid A without forming them. forrangeop tests whether the
+   WITH expression is a call of the primitive tell or grid, returning the
+   argument expression. forrangecount tests whether the value of that
+   argument gives the addresses 0 to n-1, setting n. */
+
+static int
+forrangeop(nialptr wexp, nialptr * op, nialptr * argexp)
+{
+  void        (*f) (void);
+
+  if (tag(wexp) == t_exprseq && tally(wexp) == 2)
+    wexp = fetch_array(wexp, 1);
+  if (tag(wexp) != t_opcall || tag(get_op(wexp)) != t_basic)
+    return false;
+  f = applytab[get_index(get_op(wexp))];
+  if (f != itell && f != igrid)
+    return false;
+  *op = get_op(wexp);
+  *argexp = get_argexpr(wexp);
+  return true;
+}
+
+static int
+forrangecount(nialptr op, nialptr x, nialint * n)
+{
+  if (applytab[get_index(op)] == itell) {
+    if (kind(x) != inttype || !atomic(x) || intval(x) < 0)
+      return false;
+    *n = intval(x);
+  }
+  else {
+    if (valence(x) != 1)
+      return false;
+    *n = tally(x);
+  }
+  return true;
+}
+
+/* caseselect returns the number of the branch of a CASE expression
+   selected by the value val, using the dispatch index built by parse.
+   The result is tally(vals) if no selector is equal to val. */
+
+static      nialint
+caseselect(nialptr cindex, nialptr vals, nialptr val)
+{
+  nialint     n = tally(vals),
+              v,
+              h,
+              g,
+              mask;
+
+  if (fetch_int(cindex, 0) == CASEDENSE) {
+    if (kind(val) != inttype || !atomic(val))
+      return (n);
+    v = intval(val) - fetch_int(cindex, 1);
+    if (v < 0 || v >= tally(cindex) - 2)
+      return (n);
+    return (fetch_int(cindex, v + 2));
+  }
+  mask = fetch_int(cindex, 1);
+  h = arrayhash(val) & mask;
+  while ((g = fetch_int(cindex, h + 2)) >= 0) {
+    if (equalitem(vals, g, val))
+      return (g);
+    h = (h + 1) & mask;
+  }
+  return (n);
+}
+
 /* compile the two version of eval, with and without Nial level debugging 
    enabled. This approach reduces the overhead when Nial debugging is
    turned off.
@@ -324,6 +426,8 @@ eval(nialptr exp)
 void
 apply(nialptr fn)
 {
+  nialptr     heldfn;        /* operation applied in place of a call */
+
 #ifdef DEBUG
   if (top <= 0 || top >= memsize) {
     nprintf(OF_DEBUG, "invalid arg of apply %d tag %d\n", top, tag(top));
@@ -340,80 +444,23 @@ apply(nialptr fn)
   if (CSTACKFULL)
     longjmp(error_env, NC_WARNING);
 
+  heldfn = Null;
+
 recur:
   switch (tag(fn)) {
     case t_variable:         /* code tree denotes an operation name */
         {
-          nialptr     op,
-                      entr,
-                      sym;
-          int         localtrace = trace;
-          int         namestacked = false;
-          int         local_onestep = d_onestep;
-          int         local_stepin = d_stepin;
-          int         stepskipped = false;
-
-#ifdef PROFILE
-          int         pnamestacked = false;
-#endif
-          /* get the operation code */
-          entr = get_entry(fn);
-          sym = get_sym(fn);
-          op = fetch_var(sym, entr);
-
-          if (d_next || is_systemop(fn)) {
-            d_onestep = false;
-            d_stepin = false;
-            stepskipped = true;
-          }
-
-#ifdef PROFILE
-          if (profile && !sym_flag(entr) && sym == global_symtab) {
-            profile_ops_start(entr);
-            pnamestacked = true;
-          }
-#endif
-          if ((triggered || debugging_on) && !sym_flag(entr)) {
-            /* add operation to call stack */
-            enter_op(entr);
-            namestacked = true;
-          }
-          if (sym_trflg(entr)) {
-            nprintf(OF_NORMAL_LOG, "...trace call to operation\n");
-            showexpr(fn, TRACE);
-            trace = true;
-          }
-          else               /* suspend trace if it is on */
-            trace = false;
-          if (debugging_on)
-            if (sym_brflg(entr)) {  /* flag is on for breaking in this
-                                       operation */
-              ibreak();
-              apop();
-            }
-
-          /* to protect op in case it is redefined , e.g. foo is op a {
-           * execute 'foo is op b{b + 1}'; } */
-          apush(op);
-          swap();            /* put arg back on top */
-          /* do the application of the operation */
-          apply(op);
-          swap();            /* unprotect and cleanup op */
-          freeup(apop());
-          trace = localtrace;
-#ifdef PROFILE
-          if (pnamestacked)
-            profile_ops_stop(entr);
-#endif
-          if (namestacked)
-            /* remove the operation from the call stack */
-            exit_op();
+          nialptr     entr = get_entry(fn),
+                      op;
 
-          if (stepskipped) {
-            d_onestep = local_onestep;
-            d_stepin = local_stepin;
+          if (plaincalls && !sym_trflg(entr)) {
+            /* apply op in place, holding it in case it is redefined */
+            op = fetch_var(get_sym(fn), entr);
+            holdfn(&heldfn, op);
+            fn = op;
+            goto recur;
           }
-
+          applynamed(fn, false);  /* with the call bookkeeping */
           break;
         }
 
@@ -428,47 +475,19 @@ recur:
 
     case t_opform:           /* apply operation form */
         {
-          nialptr     save_env,
-                      args = get_arglist(fn),
-                      body = get_body(fn);
-          nialptr     body_expr,
-                      val;
-          nialint     nvars = get_cnt(fn);
-          int         bsw = tag(body) == t_blockbody;
-
-          val = apop();      /* argument of the operation call */
-          prologue(get_env(fn), nvars, &save_env);  /* set up the local env. */
-          if (bsw) {         /* the body is a block */
-            nialptr     defs = get_defs(body);
-
-            body_expr = get_seq(body);
-            nonlocs = get_nonlocallist(body);
-            if (defs != grounded) {
-              eval(defs);
-              apop();        /* result is Nullexpr and is ignored */
-            }
-          }
-          else {             /* body is just an expression */
-            body_expr = body;
-            nonlocs = Null;  /* needed by lookup */
-          }
-          /* assign the arg vals to the parameter names */
-          if (!assign(args, val, false, false)) { /* assign fails if number
-                                                     of parameters differs
-                                                     from the length of the arg */
-            apush(makefault("?op_parameter"));
-          }
-          else {
-            if (trace) {
-              nprintf(OF_NORMAL_LOG, "...the arguments for the opform are\n");
-              showexpr(args, TRACE);
-            }
-            /* evaluate the body expression */
-            eval(body_expr);
+          nialptr     tailfn = callform(fn, false, plaincalls);
+
+          if (tailfn != Null) {
+            /* the body ended in a call of a named opform whose argument is
+               on the stack. Apply it in place so that the C stack does not
+               grow. */
+            holdfn(&heldfn, tailfn);
+            fn = tailfn;
+#ifdef USER_BREAK_FLAG
+            checksignal(NC_CS_NORMAL);
+#endif
+            goto recur;
           }
-          if (trace)
-            nprintf(OF_NORMAL_LOG, "...end of operation call \n");
-          epilogue(save_env, nvars);  /* restore the environment */
         }
         break;
 
@@ -604,6 +623,10 @@ recur:
         apush(makefault("?invalid case in apply"));
 #endif
   }
+  if (heldfn != Null) {
+    decrrefcnt(heldfn);
+    freeup(heldfn);
+  }
 #ifdef DEBUG
   if (top <= 0 || top >= memsize) {
     nprintf(OF_DEBUG, "invalid result of apply %d tag %d\n", top, tag(fn));
@@ -612,6 +635,233 @@ recur:
 #endif
 }
 
+/* callform applies the opform fn to the argument on the stack. If
+   paired is true fn has two parameters and they are bound to the top two
+   items of the stack, avoiding forming the pair and splitting it again.
+   The result is left on the stack and Null is returned, unless tail is
+   true and the body ends in a tail call found by tailexpr. Then the
+   activation record is discarded, the argument of the call is left on
+   the stack and the callee is returned for the caller to apply. */
+
+static      nialptr
+callform(nialptr fn, int paired, int tail)
+{
+  nialptr     save_env,
+              args = get_arglist(fn),
+              body = get_body(fn);
+  nialptr     body_expr,
+              val,
+              val2 = Null,
+              tailfn = Null;
+  nialint     nvars = get_cnt(fn),
+              save_sp;
+  int         bsw = tag(body) == t_blockbody,
+              bound;
+
+  val = apop();              /* argument of the operation call */
+  if (paired) {              /* the two arguments of a binary opform */
+    val2 = val;
+    val = apop();
+  }
+  prologue(get_env(fn), nvars, &save_env, &save_sp);  /* set up the local env. */
+  if (bsw) {                 /* the body is a block */
+    nialptr     defs = get_defs(body);
+
+    body_expr = get_seq(body);
+    nonlocs = get_nonlocallist(body);
+    if (defs != grounded) {
+      eval(defs);
+      apop();                /* result is Nullexpr and is ignored */
+    }
+  }
+  else {                     /* body is just an expression */
+    body_expr = body;
+    nonlocs = Null;          /* needed by lookup */
+  }
+  /* assign the arg vals to the parameter names */
+  if (paired) {
+    nialptr     var1 = fetch_array(args, 1),
+                var2 = fetch_array(args, 2);
+
+    store_var(get_sym(var1), get_entry(var1), val);
+    store_var(get_sym(var2), get_entry(var2), val2);
+    bound = true;
+  }
+  else
+    bound = assign(args, val, false, false);
+  if (!bound) {              /* assign fails if number of parameters
+                                differs from the length of the arg */
+    apush(makefault("?op_parameter"));
+  }
+  else {
+    if (trace) {
+      nprintf(OF_NORMAL_LOG, "...the arguments for the opform are\n");
+      showexpr(args, TRACE);
+    }
+    /* evaluate the body expression */
+    if (tail)
+      tailfn = tailexpr(body_expr);
+    else
+      eval(body_expr);
+  }
+  if (trace)
+    nprintf(OF_NORMAL_LOG, "...end of operation call \n");
+  if (tailfn != Null) {      /* discard the activation, keeping the arg */
+    val = apop();
+    incrrefcnt(val);
+    dropframe(save_env, save_sp, nvars);
+    decrrefcnt(val);
+    apush(val);
+  }
+  else
+    epilogue(save_env, save_sp, nvars); /* restore the environment */
+  return (tailfn);
+}
+
+/* applypair applies fn to the pair formed by the top two items of the
+   stack. It is used for a call with a two item strand or list argument.
+   If fn names an opform with two parameters, they are bound directly to
+   the two values. */
+
+static void
+applypair(nialptr fn)
+{
+  nialptr     op = fn,
+              tailfn;
+
+  if (tag(op) == t_variable) {
+    if (!plaincalls || sym_trflg(get_entry(op))) {
+      applynamed(fn, true);
+      return;
+    }
+    op = fetch_var(get_sym(op), get_entry(op));
+  }
+  if (tag(op) != t_opform || tally(get_arglist(op)) != 3) {
+    mklist(2);
+    apply(fn);
+    return;
+  }
+  incrrefcnt(op);            /* hold op in case it is redefined */
+  tailfn = callform(op, true, plaincalls);
+  if (tailfn != Null) {
+    incrrefcnt(tailfn);
+    apply(tailfn);
+    decrrefcnt(tailfn);
+    freeup(tailfn);
+  }
+  decrrefcnt(op);
+  freeup(op);
+}
+
+/* applynamed applies the operation named by fn with the bookkeeping
+   needed by tracing, profiling, fault triggering and the debugger. If
+   paired is true the argument is the top two items of the stack. An
+   opform is applied with callform so that, when tailcalls allows it, a
+   call in tail position reuses the activation record as in apply. The
+   operation called then takes the place of the caller on the call stack. */
+
+static void
+applynamed(nialptr fn, int paired)
+{
+  nialptr     op,
+              entr,
+              sym,
+              tailfn,
+              heldfn = Null;
+  int         localtrace = trace;
+  int         namestacked = false;
+  int         local_onestep = d_onestep;
+  int         local_stepin = d_stepin;
+  int         stepskipped = false;
+
+#ifdef PROFILE
+  int         pnamestacked = false;
+#endif
+  /* get the operation code */
+  entr = get_entry(fn);
+  sym = get_sym(fn);
+  op = fetch_var(sym, entr);
+
+  if (paired && (tag(op) != t_opform || tally(get_arglist(op)) != 3)) {
+    mklist(2);               /* form the argument pair */
+    paired = false;
+  }
+
+  if (d_next || is_systemop(fn)) {
+    d_onestep = false;
+    d_stepin = false;
+    stepskipped = true;
+  }
+
+#ifdef PROFILE
+  if (profile && !sym_flag(entr) && sym == global_symtab) {
+    profile_ops_start(entr);
+    pnamestacked = true;
+  }
+#endif
+  if ((triggered || debugging_on) && !sym_flag(entr)) {
+    /* add operation to call stack */
+    enter_op(entr);
+    namestacked = true;
+  }
+  if (sym_trflg(entr)) {
+    nprintf(OF_NORMAL_LOG, "...trace call to operation\n");
+    showexpr(fn, TRACE);
+    trace = true;
+  }
+  else                       /* suspend trace if it is on */
+    trace = false;
+  if (debugging_on)
+    if (sym_brflg(entr)) {   /* flag is on for breaking in this operation */
+      ibreak();
+      apop();
+    }
+
+  /* to protect op in case it is redefined , e.g. foo is op a {
+   * execute 'foo is op b{b + 1}'; } */
+  incrrefcnt(op);
+  /* do the application of the operation */
+  if (tag(op) == t_opform) {
+    tailfn = callform(op, paired, tailcalls);
+    while (tailfn != Null) {
+      holdfn(&heldfn, tailfn);
+      if ((triggered || debugging_on) && !sym_flag(tailentr)) {
+        if (namestacked)
+          tail_op(tailentr);
+        else {
+          enter_op(tailentr);
+          namestacked = true;
+        }
+      }
+#ifdef USER_BREAK_FLAG
+      checksignal(NC_CS_NORMAL);
+#endif
+      tailfn = callform(heldfn, false, tailcalls);
+    }
+    if (heldfn != Null) {
+      decrrefcnt(heldfn);
+      freeup(heldfn);
+    }
+  }
+  else
+    apply(op);
+  decrrefcnt(op);            /* unprotect and cleanup op */
+  freeup(op);
+  trace = localtrace;
+#ifdef PROFILE
+  if (pnamestacked)
+    profile_ops_stop(entr);
+#endif
+  if (namestacked)
+    /* remove the operation from the call stack */
+    exit_op();
+
+  if (stepskipped) {
+    d_onestep = local_onestep;
+    d_stepin = local_stepin;
+  }
+}
+
 /* routine to apply a transform */
 
 static void
@@ -701,7 +951,8 @@ apply_transform(nialptr tr)
                       trbody,
                       save_env,
                       val;
-          nialint     nargs;
+          nialint     nargs,
+                      save_sp;
           int         closureflag = false;
 
           fval = apop();
@@ -709,7 +960,7 @@ apply_transform(nialptr tr)
           args = get_opargs(tr);
           nargs = tally(args) - 1;
           if (nargs > 0)
-            prologue(get_env(tr), nargs, &save_env);  /* set up the local env */
+            prologue(get_env(tr), nargs, &save_env, &save_sp);  /* set up the local env */
 #ifdef PROFILE
           if (nargs > 1 && (triggered || debugging_on || profile))
 #else
@@ -748,7 +999,7 @@ apply_transform(nialptr tr)
             apply(trbody);
           }
           if (nargs > 0)
-            epilogue(save_env, nargs);  /* restore argument */
+            epilogue(save_env, save_sp, nargs);  /* restore argument */
           if (closureflag) {
             decrrefcnt(fval);
             freeup(fval);
@@ -944,19 +1195,18 @@ cleanup:
   sets up the static environment appropriate to the body to be evaluated and
    extends the dynamic environment, adding a new local environment
    corresponding to the first sym in the given environment list. The current
-   stack pointer for that sym table is saved on the stack and reset to the
-   top of stack.
+   stack pointer for that sym table is saved in *ssp and reset to the
+   top of stack. The stack pointers are raw integers, see store_sp.
    On completion of prologue the stack will contain:
                    . . .
                  space for the result
-                 OLDSP for symbol table sym
    cursp(sym)--> value cell for var 0
                 . . .
    topstack----> value cell for var nvars-1
 */
 
 static void
-prologue(nialptr env, nialint nvars, nialptr * senv)
+prologue(nialptr env, nialint nvars, nialptr * senv, nialint * ssp)
 {
   int         i;
   nialptr     newsym;
@@ -966,8 +1216,8 @@ prologue(nialptr env, nialint nvars, nialptr * senv)
   current_env = env;
   apush(no_value);           /* reserve space for the result */
   newsym = fetch_int(env, 0);/* get the new symbol table number */
-  apush(get_sp(newsym));     /* push the old stack pointer value */
-  store_sp(newsym, createint(topstack + 1));  /* store new stack pointer */
+  *ssp = get_spval(newsym);  /* save the old stack pointer value */
+  store_sp(newsym, topstack + 1); /* store new stack pointer */
   for (i = 0; i < nvars; i++)
     apush(no_value);         /* initialize the local names */
 }
@@ -975,17 +1225,166 @@ prologue(nialptr env, nialint nvars, nialptr * senv)
 /* routine to undo the work of prologue */
 
 static void
-epilogue(nialptr senv, nialint nvars)
+epilogue(nialptr senv, nialint ssp, nialint nvars)
 {
   int         i;
   nialptr     newsym = fetch_array(current_env, 0); /* get the symbol table no */
 
   current_env = senv;        /* restore current environment */
   decrrefcnt(no_value);      /* remove refcnt on fault in result posn */
-  movetop(nvars + 2);        /* move the result to its reserved space */
+  movetop(nvars + 1);        /* move the result to its reserved space */
+  for (i = 0; i < nvars; i++)
+    freeup(apop());          /* free and deallocate local variable */
+  store_sp(newsym, ssp);     /* store the old stack pointer */
+}
+
+/* routine used by apply to hold the operation it is applying in place
+   of a call, releasing the one held before */
+
+static void
+holdfn(nialptr * hfn, nialptr fn)
+{
+  incrrefcnt(fn);
+  if (*hfn != Null) {
+    decrrefcnt(*hfn);
+    freeup(*hfn);
+  }
+  *hfn = fn;
+}
+
+/* routine to discard an activation record without leaving a result. It
+   is used when an operation body ends in a tail call. */
+
+static void
+dropframe(nialptr senv, nialint ssp, nialint nvars)
+{
+  int         i;
+  nialptr     newsym = fetch_array(current_env, 0); /* get the symbol table no */
+
+  current_env = senv;        /* restore current environment */
   for (i = 0; i < nvars; i++)
     freeup(apop());          /* free and deallocate local variable */
-  store_sp(newsym, apop());  /* store the old stack pointer */
+  store_sp(newsym, ssp);     /* store the old stack pointer */
+  apop();                    /* remove no_value from the result posn */
+}
+
+/* tailexpr evaluates the body of an opform as eval does, following
+   expression sequences and IF expressions to the expression in tail
+   position. If that is a call of a named opform, the argument is left on
+   the stack and the opform is returned so that apply can reuse the
+   activation record. Its entry is left in tailentr. Otherwise the value
+   of the body is left on the stack and the result is Null. An opform
+   defined within the current one is not returned since it refers to the
+   record being discarded, nor is one being traced or with a breakpoint.
+   If stepping starts part way through, the rest is evaluated by eval so
+   that the steps are shown. */
+
+static      nialptr
+tailexpr(nialptr exp)
+{
+  nialptr     val,
+              op,
+              entr,
+              callee;
+  nialint     n,
+              i;
+
+  while (tailcalls) {
+    switch (tag(exp)) {
+      case t_exprseq:
+          n = tally(exp);
+          if (n < 2)
+            break;
+          for (i = 1; i < n - 1; i++) {
+            eval(fetch_array(exp, i));
+            if (nialexitflag)
+              return (Null);
+            freeup(apop());
+            if (!tailcalls) {
+              restseq(exp, i + 1);
+              return (Null);
+            }
+          }
+          exp = fetch_array(exp, n - 1);
+          continue;
+
+      case t_ifexpr:
+          n = tally(exp);
+          i = 1;
+          while ((n - i) > 1) {  /* has test and then expr */
+            eval(get_test(exp, i));
+            val = apop();
+            if (kind(val) != booltype || valence(val) != 0) {
+              freeup(val);
+              apush(Logical);/* answer is ?L if a test is non-boolean */
+              return (Null);
+            }
+            if (boolval(val))
+              break;
+            freeup(val);
+            i = i + 2;
+          }
+          if ((n - i) > 1) {
+            freeup(val);
+            exp = get_thenexpr(exp, i);
+          }
+          else if ((n - i) == 1)
+            exp = get_elseexpr(exp, i);
+          else {
+            apush(Nullexpr);
+            return (Null);
+          }
+          continue;
+
+      case t_opcall:
+          op = get_op(exp);
+          if (tag(op) != t_variable)
+            break;
+          eval(get_argexpr(exp));
+          entr = get_entry(op);
+          callee = fetch_var(get_sym(op), entr);
+          if (tag(callee) == t_opform && !sym_trflg(entr) &&
+              !(debugging_on && sym_brflg(entr)) && tailcalls) {
+            nialptr     env = get_env(callee),
+                        sym = fetch_array(current_env, 0);
+
+            for (i = 1; i < tally(env); i++)
+              if (fetch_array(env, i) == sym)
+                break;
+            if (i >= tally(env)) {
+              tailentr = entr;
+              return (callee);
+            }
+          }
+          apply(op);
+          return (Null);
+    }
+    break;
+  }
+  eval(exp);
+  return (Null);
+}
+
+/* restseq evaluates the items of the expression sequence exp from
+   position i on as a sequence of their own. tailexpr uses it when
+   stepping starts part way through a sequence. The end of the sequence
+   is then treated as eval would treat the end of exp. */
+
+static void
+restseq(nialptr exp, nialint i)
+{
+  nialptr     rest = st_exprseq(fetch_array(exp, i));
+
+  for (i++; i < tally(exp); i++)
+    rest = nial_extend(rest, fetch_array(exp, i));
+  incrrefcnt(rest);
+  eval(rest);
+  decrrefcnt(rest);
+  freeup(rest);
+  if (d_toend && !d_inloop) {  /* toend was set within exp */
+    d_toend = false;
+    d_onestep = true;
+  }
 }
 
 
@@ -1264,7 +1663,7 @@ b_closure()
   t = tally(sps);
   for (i = 0; i < t; i++) {
     sym = fetch_int(current_env, i);
-    sp = get_sp(sym);
+    sp = createint(get_spval(sym));
     store_array(sps, i, sp);
   }
   /* build the closure */
@@ -1291,10 +1690,10 @@ setup_env(nialptr syms, nialptr sps, nialptr * svenv)
     current_env = syms;
     for (i = 0; i < t; i++) {
       sym = fetch_int(syms, i);
-      apush(get_sp(sym));    /* push the saved stack pointer */
+      apush(createint(get_spval(sym))); /* push the saved stack pointer */
       swap();                /* to put the arg on top */
       sp = fetch_array(sps, i); /* get the sp from the closure */
-      store_sp(sym, sp);     /* and install it */
+      store_sp(sym, intval(sp));  /* and install it */
     }
   }
 }
@@ -1304,7 +1703,8 @@ setup_env(nialptr syms, nialptr sps, nialptr * svenv)
 static void
 restore_env(nialptr syms, nialptr svenv)
 {
-  nialptr     sym;
+  nialptr     sym,
+              sp;
   nialint     t,
               i;
 
@@ -1313,7 +1713,9 @@ restore_env(nialptr syms, nialptr svenv)
     for (i = t - 1; i >= 0; i--) {
       sym = fetch_int(syms, i);
       swap();                /* to move result down 1 in the stack */
-      store_sp(sym, apop());
+      sp = apop();
+      store_sp(sym, intval(sp));
+      freeup(sp);
     }
   }
   current_env = svenv;
@@ -1373,14 +1775,18 @@ iexecute()
 }
 
 /* routine to implement the tonumber operation.
-   This does scan and parse on it. A version that
-   used atoi or atof directly would be faster. 
+   A plain decimal integer or real is converted directly by scan_number.
+   Anything else does scan and parse on it.
    If the routine is modified, it must produce the same numeric value
    generated by scan and fault in the same way. */
 
 void
 itonumber(void)
 {
+  nialint     ival;
+  double      rval;
+  int         res;
+
   if (kind(top) != chartype) 
   { if (kind(top) != phrasetype)
     { freeup(apop());
@@ -1389,6 +1795,19 @@ itonumber(void)
     }
     istring(); /* convert the argument to a string */
   }
+  if (valence(top) <= 1) {
+    res = scan_number(pfirstchar(top), tally(top), &ival, &rval);
+    if (res != 0) {
+      freeup(apop());
+      if (res == 1) {
+        apush(createint(ival));
+      }
+      else {
+        apush(createreal(rval));
+      }
+      return;
+    }
+  }
   iscan();
   parse(true);
   {
@@ -1418,6 +1837,157 @@ itonumber(void)
   }
 }
 
+/* routine to implement the tonumbers operation, a bulk version of tonumber
+   for columns of numbers read from files. The argument is a list of
+   strings or phrases, a single string holding numbers separated by
+   blanks, or a pair of a string and a separator character. The result is
+   a pair: a list of the numbers, integers if every field is an integer and
+   reals otherwise, and a boolean list that is o where the field does not
+   hold a plain decimal number. Such a field gives 0 in the numbers.
+   The fields are located and converted before any array is created
+   since creating an array may move the heap. */
+
+void
+itonumbers(void)
+{
+  nialptr     x = apop(),
+              z,
+              mask;
+  nialint     i,
+              n = 0,
+              cap = 0,
+             *ivals = NULL;
+  double     *rvals = NULL;
+  char       *ok = NULL,
+              sep = ' ';
+  int         anyreal = false,
+              splitmode = false;
+
+  /* decide the form of the argument */
+  if (kind(x) == chartype && valence(x) == 1)
+    splitmode = true;
+  else if (kind(x) == atype && tally(x) == 2 && valence(x) == 1 &&
+           kind(fetch_array(x, 0)) == chartype &&
+           valence(fetch_array(x, 0)) == 1 &&
+           kind(fetch_array(x, 1)) == chartype &&
+           atomic(fetch_array(x, 1))) {
+    sep = charval(fetch_array(x, 1));
+    splitmode = true;
+  }
+  else if (kind(x) != atype && kind(x) != phrasetype && kind(x) != chartype &&
+           tally(x) != 0) {
+    freeup(x);
+    buildfault("tonumbers arg is not a list of strings");
+    return;
+  }
+
+  if (splitmode) {
+    nialptr     txt = (kind(x) == chartype ? x : fetch_array(x, 0));
+    char       *s = pfirstchar(txt);
+    nialint     len = tally(txt),
+                pos = 0;
+
+    while (pos <= len) {
+      nialint     fend;
+      int         res;
+
+      if (sep == ' ') {      /* fields are runs of non-blank characters */
+        while (pos < len && isspace((unsigned char) s[pos]))
+          pos++;
+        if (pos == len)
+          break;
+        fend = pos;
+        while (fend < len && !isspace((unsigned char) s[fend]))
+          fend++;
+      }
+      else {
+        fend = pos;
+        while (fend < len && s[fend] != sep)
+          fend++;
+        /* a trailing separator does not start another field */
+        if (pos == len)
+          break;
+      }
+      if (n == cap) {
+        cap = (cap == 0 ? 64 : 2 * cap);
+        ivals = (nialint *) realloc(ivals, cap * sizeof(nialint));
+        rvals = (double *) realloc(rvals, cap * sizeof(double));
+        ok = (char *) realloc(ok, cap);
+        if (ivals == NULL || rvals == NULL || ok == NULL)
+          exit_cover1("Not enough memory to continue", NC_FATAL);
+      }
+      res = scan_number(s + pos, fend - pos, &ivals[n], &rvals[n]);
+      ok[n] = (res != 0);
+      if (res == 1)
+        rvals[n] = (double) ivals[n];
+      else if (res == 2)
+        anyreal = true;
+      else {
+        ivals[n] = 0;
+        rvals[n] = 0.0;
+      }
+      n++;
+      pos = fend + 1;
+    }
+  }
+  else {
+    n = tally(x);
+    ivals = (nialint *) malloc((n == 0 ? 1 : n) * sizeof(nialint));
+    rvals = (double *) malloc((n == 0 ? 1 : n) * sizeof(double));
+    ok = (char *) malloc(n == 0 ? 1 : n);
+    if (ivals == NULL || rvals == NULL || ok == NULL)
+      exit_cover1("Not enough memory to continue", NC_FATAL);
+    for (i = 0; i < n; i++) {
+      nialptr     xi = (kind(x) == atype ? fetch_array(x, i) : x);
+      char       *s = NULL;
+      nialint     len = 0;
+      int         res = 0;
+
+      if (kind(x) == phrasetype) {
+        s = pfirstchar(x);
+        len = strlen(s);
+      }
+      else if (kind(x) == chartype) {
+        s = pfirstchar(x) + i;
+        len = 1;
+      }
+      else if (kind(xi) == chartype && valence(xi) <= 1) {
+        s = pfirstchar(xi);
+        len = tally(xi);
+      }
+      else if (kind(xi) == phrasetype) {
+        s = pfirstchar(xi);
+        len = strlen(s);
+      }
+      if (s != NULL)
+        res = scan_number(s, len, &ivals[i], &rvals[i]);
+      ok[i] = (res != 0);
+      if (res == 1)
+        rvals[i] = (double) ivals[i];
+      else if (res == 2)
+        anyreal = true;
+      else {
+        ivals[i] = 0;
+        rvals[i] = 0.0;
+      }
+    }
+  }
+
+  z = new_create_array(anyreal ? realtype : inttype, 1, 0, &n);
+  if (anyreal)
+    memcpy(pfirstreal(z), rvals, n * sizeof(double));
+  else
+    memcpy(pfirstint(z), ivals, n * sizeof(nialint));
+  mask = new_create_array(booltype, 1, 0, &n);
+  for (i = 0; i < n; i++)
+    store_bool(mask, i, ok[i]);
+  free(ivals);
+  free(rvals);
+  free(ok);
+  freeup(x);
+  apush(mkapair(z, mask));
+}
+
 /* routine to implement the primitive operation getname which converts a 
    variable reference from a parse tree to its print value in upper case.
 */
@@ -2562,6 +3132,16 @@ exit_op()
   }
 }
 
+/* routine to replace the operation on top of the call stack by the one
+   it has called in tail position */
+
+static void
+tail_op(nialptr entr)
+{
+  if (call_stack_pointer > 0)
+    call_stack[call_stack_pointer - 1] = entr;
+}
+
 /* routine to support the primitive expression Callstack.
   Because the op call stack will be cleaned up on it's own
   this function does not free up the stack entries, nor does
@@ -52,7 +52,8 @@
 #include "if.h"
 #include "fileio.h"
 
-#include "utils.h"           /* for ngetname */
+#include "utils.h"           /* for ngetname, scan_number */
+#include "blders.h"          /* for mkapair */
 
 #ifdef UNIXSYS
 #include "linenoise.h"
@@ -1237,6 +1238,567 @@ igetfile()
     apush(Null);
 }
 
+/* routines to implement readcsv, which reads a delimited text file into
+   a list of columns. Each column is an integer list, a real list or a
+   list of strings. The argument is the file name, or a list of
+
+     Filename Delimiter Quote Types Start Rows
+
+   where trailing items may be omitted. Delimiter defaults to a comma and
+   Quote to a double quote; an empty Quote turns quoting off. Types is a
+   string with one letter per column: i for integer, r for real, s for
+   string and ? to infer the type from the first CSVSAMPLE rows. A single
+   letter applies to every column and the default is to infer all of them.
+   Start is a byte offset in the file. If Rows is given, at most that many
+   rows are read and the result is the pair of the columns and the offset
+   of the next row, or -1 at the end of the file, so that a file larger
+   than the workspace can be processed in pieces.
+
+   The file is read in blocks and scanned a word at a time for the
+   delimiter, quote and newline characters. The fields of each row are
+   converted straight into C buffers for their columns, so the Nial
+   arrays are built once at the end and no item is boxed on the way.
+   A field that does not fit the type of its column gives 0, except that
+   an inferred integer column is widened to real on the first real field.
+*/
+
+#define CSVSAMPLE 1000       /* rows used to infer column types */
+#define CSVBLOCK  (1 << 20)  /* initial size of the file buffer */
+
+typedef struct {
+  int         type;          /* 'i', 'r', 's' or 0 if not yet known */
+  int         hinted;        /* type given by the caller */
+  nialint     n,
+              cap;
+  nialint    *ivals;
+  double     *rvals;
+  nialint    *offs;          /* string start in text, n+1 entries */
+  char       *text;
+  nialint     textlen,
+              textcap;
+} csvcol;
+
+typedef struct {
+  FILE       *f;
+  char       *buf;
+  nialint     cap,
+              beg,           /* unread data is buf[beg .. end) */
+              end;
+  long        base;          /* file offset of buf[0] */
+  int         eof;
+  char        delim,
+              quote;
+  int         hasquote;
+  nialint     nf,            /* fields of the current row */
+              fcap;
+  nialint    *fstart,
+             *flen;
+  char       *fquoted;       /* 1 if quoted, 2 if it has doubled quotes */
+} csvreader;
+
+#define SWARONES  0x0101010101010101ULL
+#define SWARHIGHS 0x8080808080808080ULL
+#define swarzero(v) (((v) - SWARONES) & ~(v) & SWARHIGHS)
+
+/* find the next delimiter, quote or newline at or after p */
+
+static nialint
+csvscan(csvreader * r, nialint p)
+{
+  char       *s = r->buf;
+  nialint     end = r->end;
+  unsigned long long dm = SWARONES * (unsigned char) r->delim,
+              qm = SWARONES * (unsigned char) r->quote,
+              nm = SWARONES * (unsigned char) '\n';
+
+  while (p + 8 <= end) {
+    unsigned long long w;
+
+    memcpy(&w, s + p, 8);
+    if (swarzero(w ^ dm) | swarzero(w ^ qm) | swarzero(w ^ nm))
+      break;
+    p += 8;
+  }
+  while (p < end && s[p] != r->delim && s[p] != r->quote && s[p] != '\n')
+    p++;
+  return (p);
+}
+
+/* move the unread data to the front of the buffer and read more of the
+   file, growing the buffer if a row does not fit. */
+
+static int
+csvfill(csvreader * r)
+{
+  nialint     keep = r->end - r->beg,
+              got;
+
+  if (r->beg > 0) {
+    memmove(r->buf, r->buf + r->beg, keep);
+    r->base += (long) r->beg;
+    r->beg = 0;
+    r->end = keep;
+  }
+  if (r->end == r->cap) {
+    char       *nb = (char *) realloc(r->buf, 2 * r->cap);
+
+    if (nb == NULL)
+      return (false);
+    r->buf = nb;
+    r->cap *= 2;
+  }
+  got = (nialint) fread(r->buf + r->end, 1, r->cap - r->end, r->f);
+  r->end += got;
+  if (got < r->cap - keep)
+    r->eof = true;
+  return (true);
+}
+
+static int
+csvaddfield(csvreader * r, nialint fs, nialint fl, int q)
+{
+  if (r->nf == r->fcap) {
+    nialint     nc = (r->fcap == 0 ? 64 : 2 * r->fcap);
+    nialint    *ns = (nialint *) realloc(r->fstart, nc * sizeof(nialint));
+
+    if (ns == NULL)
+      return (false);
+    r->fstart = ns;
+    ns = (nialint *) realloc(r->flen, nc * sizeof(nialint));
+    if (ns == NULL)
+      return (false);
+    r->flen = ns;
+    r->fquoted = (char *) realloc(r->fquoted, nc);
+    if (r->fquoted == NULL)
+      return (false);
+    r->fcap = nc;
+  }
+  r->fstart[r->nf] = fs;
+  r->flen[r->nf] = fl;
+  r->fquoted[r->nf] = (char) q;
+  r->nf++;
+  return (true);
+}
+
+/* split the row at r->beg into fields. Returns 1 with *next set to the
+   start of the following row, 0 if the buffer must be refilled, -1 at the
+   end of the file and -2 if out of memory. */
+
+static int
+csvrow(csvreader * r, nialint * next)
+{
+  char       *s = r->buf;
+  nialint     p = r->beg,
+              end = r->end;
+
+  r->nf = 0;
+  if (p >= end)
+    return (r->eof ? -1 : 0);
+  while (true) {
+    nialint     fs,
+                fl;
+    int         q = 0;
+
+    if (r->hasquote && p < end && s[p] == r->quote) {
+      q = 1;
+      fs = ++p;
+      while (true) {
+        while (p < end && s[p] != r->quote)
+          p++;
+        if (p + 1 >= end && !r->eof)
+          return (0);        /* cannot tell if the quote is doubled */
+        if (p + 1 < end && s[p + 1] == r->quote) {
+          q = 2;
+          p += 2;
+          continue;
+        }
+        break;
+      }
+      fl = (p < end ? p : end) - fs;
+      /* ignore anything between the closing quote and the delimiter */
+      while (p < end && s[p] != r->delim && s[p] != '\n')
+        p++;
+    }
+    else {
+      fs = p;
+      p = csvscan(r, p);
+      while (r->hasquote && p < end && s[p] == r->quote) /* a quote inside a field */
+        p = csvscan(r, p + 1);
+      fl = p - fs;
+      if (fl > 0 && s[fs + fl - 1] == '\r' && (p == end || s[p] == '\n'))
+        fl--;
+    }
+    if (p >= end && !r->eof)
+      return (0);
+    if (!csvaddfield(r, fs, fl, q))
+      return (-2);
+    if (p >= end) {
+      *next = end;
+      return (1);
+    }
+    if (s[p] == r->delim)
+      p++;
+    else {
+      *next = p + 1;
+      return (1);
+    }
+  }
+}
+
+/* add field f of the current row to column c */
+
+static int
+csvstore(csvreader * r, csvcol * c, nialint f)
+{
+  char       *s = (f < r->nf ? r->buf + r->fstart[f] : "");
+  nialint     len = (f < r->nf ? r->flen[f] : 0),
+              ival = 0,
+              i;
+  double      rval = 0.0;
+  int         res = 0,
+              q = (f < r->nf ? r->fquoted[f] : 0);
+
+  if (c->n + 1 >= c->cap) {
+    nialint     nc = (c->cap == 0 ? 1024 : 2 * c->cap);
+
+    if (c->type == 's') {
+      nialint    *no = (nialint *) realloc(c->offs, nc * sizeof(nialint));
+
+      if (no == NULL)
+        return (false);
+      c->offs = no;
+    }
+    else {
+      nialint    *ni = (nialint *) realloc(c->ivals, nc * sizeof(nialint));
+      double     *nr;
+
+      if (ni == NULL)
+        return (false);
+      c->ivals = ni;
+      nr = (double *) realloc(c->rvals, nc * sizeof(double));
+      if (nr == NULL)
+        return (false);
+      c->rvals = nr;
+    }
+    c->cap = nc;
+  }
+
+  if (c->type == 's') {
+    if (c->textlen + len + 1 > c->textcap) {
+      nialint     nc = 2 * (c->textcap + len + 1);
+      char       *nt = (char *) realloc(c->text, nc);
+
+      if (nt == NULL)
+        return (false);
+      c->text = nt;
+      c->textcap = nc;
+    }
+    c->offs[c->n] = c->textlen;
+    for (i = 0; i < len; i++) {
+      c->text[c->textlen++] = s[i];
+      if (q == 2 && s[i] == r->quote && i + 1 < len && s[i + 1] == r->quote)
+        i++;                 /* a doubled quote stands for one */
+    }
+    c->n++;
+    c->offs[c->n] = c->textlen;
+    return (true);
+  }
+
+  if (q != 2)
+    res = scan_number(s, len, &ival, &rval);
+  if (c->type == 'i') {
+    if (res == 2 && !c->hinted) {
+      /* widen the column to real */
+      for (i = 0; i < c->n; i++)
+        c->rvals[i] = (double) c->ivals[i];
+      c->type = 'r';
+    }
+    else {
+      c->ivals[c->n++] = (res == 1 ? ival : 0);
+      return (true);
+    }
+  }
+  c->rvals[c->n++] = (res == 1 ? (double) ival : res == 2 ? rval : 0.0);
+  return (true);
+}
+
+/* infer the type of column c from field f of a sample row */
+
+static void
+csvinfer(csvreader * r, csvcol * c, nialint f)
+{
+  nialint     ival;
+  double      rval;
+  int         res;
+
+  if (c->hinted || c->type == 's' || f >= r->nf || r->flen[f] == 0)
+    return;
+  res = (r->fquoted[f] == 2 ? 0 :
+         scan_number(r->buf + r->fstart[f], r->flen[f], &ival, &rval));
+  if (res == 0)
+    c->type = 's';
+  else if (res == 2)
+    c->type = 'r';
+  else if (c->type == 0)
+    c->type = 'i';
+}
+
+/* read rows from offset start into the columns. With cols NULL the rows
+   are only used to find the number of columns. With sample true the
+   types of unhinted columns are inferred instead of storing values.
+   Returns the number of rows read or -1 if out of memory. */
+
+static nialint
+csvpass(csvreader * r, long start, nialint maxrows, csvcol ** cols,
+        nialint * ncols, int sample)
+{
+  nialint     rows = 0,
+              next,
+              i;
+  int         res;
+
+  fseek(r->f, start, SEEK_SET);
+  r->base = start;
+  r->beg = r->end = 0;
+  r->eof = false;
+  while (maxrows <= 0 || rows < maxrows) {
+    res = csvrow(r, &next);
+    if (res == 0) {
+      if (!csvfill(r))
+        return (-1);
+      continue;
+    }
+    if (res == -2)
+      return (-1);
+    if (res == -1)
+      break;
+    if (r->nf == 1 && r->flen[0] == 0 && r->fquoted[0] == 0) {
+      r->beg = next;         /* skip a blank line */
+      continue;
+    }
+    if (*cols == NULL) {
+      *ncols = r->nf;
+      *cols = (csvcol *) calloc(*ncols == 0 ? 1 : *ncols, sizeof(csvcol));
+      if (*cols == NULL)
+        return (-1);
+    }
+    for (i = 0; i < *ncols; i++) {
+      if (sample)
+        csvinfer(r, &(*cols)[i], i);
+      else if (!csvstore(r, &(*cols)[i], i))
+        return (-1);
+    }
+    r->beg = next;
+    rows++;
+  }
+  return (rows);
+}
+
+static void
+csvfree(csvreader * r, csvcol * cols, nialint ncols)
+{
+  nialint     i;
+
+  if (cols != NULL) {
+    for (i = 0; i < ncols; i++) {
+      free(cols[i].ivals);
+      free(cols[i].rvals);
+      free(cols[i].offs);
+      free(cols[i].text);
+    }
+    free(cols);
+  }
+  free(r->buf);
+  free(r->fstart);
+  free(r->flen);
+  free(r->fquoted);
+}
+
+void
+ireadcsv()
+{
+  nialptr     x = apop(),
+              nm,
+              z;
+  csvreader   rd;
+  csvcol     *cols = NULL;
+  nialint     ncols = 0,
+              maxrows = 0,
+              rows,
+              i,
+              j,
+              tx = (kind(x) == atype ? tally(x) : 1);
+  long        start = 0,
+              next;
+  char        types[256];
+  int         chunked = false;
+
+  memset(&rd, 0, sizeof(rd));
+  rd.delim = ',';
+  rd.quote = '"';
+  types[0] = '\0';
+  nm = (kind(x) == atype ? (tx > 0 ? fetch_array(x, 0) : Null) : x);
+  if (tx > 6 || ngetname(nm, gcharbuf) == 0) {
+    freeup(x);
+    buildfault("readcsv arg is not a file name or list of options");
+    return;
+  }
+  if (tx >= 2) {
+    nialptr     it = fetch_array(x, 1);
+
+    if (kind(it) != chartype || !atomic(it)) {
+      freeup(x);
+      buildfault("readcsv delimiter is not a character");
+      return;
+    }
+    rd.delim = charval(it);
+  }
+  if (tx >= 3) {
+    nialptr     it = fetch_array(x, 2);
+
+    if (kind(it) == chartype && atomic(it))
+      rd.quote = charval(it);
+    else if (tally(it) == 0)
+      rd.quote = rd.delim;   /* no quoting */
+    else {
+      freeup(x);
+      buildfault("readcsv quote is not a character");
+      return;
+    }
+  }
+  rd.hasquote = (rd.quote != rd.delim);
+  if (tx >= 4) {
+    nialptr     it = fetch_array(x, 3);
+
+    if (tally(it) != 0 && (!istext(it) || tally(it) > 255)) {
+      freeup(x);
+      buildfault("readcsv types is not a string");
+      return;
+    }
+    if (tally(it) != 0) {
+      if (kind(it) == chartype && atomic(it)) {
+        types[0] = charval(it);
+        types[1] = '\0';
+      }
+      else
+        strcpy(types, pfirstchar(it));
+    }
+  }
+  for (i = 0; types[i] != '\0'; i++)
+    if (strchr("irs?", types[i]) == NULL) {
+      freeup(x);
+      buildfault("readcsv types must be letters i, r, s or ?");
+      return;
+    }
+  if (tx >= 5) {
+    nialptr     it = fetch_array(x, 4);
+
+    if (kind(it) != inttype || !atomic(it) || intval(it) < 0) {
+      freeup(x);
+      buildfault("readcsv start is not an offset");
+      return;
+    }
+    start = (long) intval(it);
+  }
+  if (tx == 6) {
+    nialptr     it = fetch_array(x, 5);
+
+    if (kind(it) != inttype || !atomic(it) || intval(it) <= 0) {
+      freeup(x);
+      buildfault("readcsv rows is not a positive integer");
+      return;
+    }
+    maxrows = intval(it);
+    chunked = true;
+  }
+  freeup(x);
+
+  rd.f = openfile(gcharbuf, 'r', 'b');
+  if (rd.f == OPENFAILED) {
+    buildfault(errmsgptr);
+    return;
+  }
+  rd.cap = CSVBLOCK;
+  rd.buf = (char *) malloc(rd.cap);
+  if (rd.buf == NULL)
+    goto nomemory;
+
+  /* find the columns and infer their types from a sample */
+  if (csvpass(&rd, start, 1, &cols, &ncols, true) < 0)
+    goto nomemory;
+  {
+    int         ninfer = 0;
+    nialint     ntypes = (nialint) strlen(types);
+
+    for (i = 0; i < ncols; i++) {
+      char        t = (ntypes == 0 ? '?' : ntypes == 1 ? types[0] :
+                       i < ntypes ? types[i] : '?');
+
+      if (t == '?')
+        ninfer++;
+      else {
+        cols[i].type = t;
+        cols[i].hinted = true;
+      }
+    }
+    if (ninfer > 0) {
+      nialint     nsample = (maxrows > 0 && maxrows < CSVSAMPLE ? maxrows : CSVSAMPLE);
+
+      if (csvpass(&rd, start, nsample, &cols, &ncols, true) < 0)
+        goto nomemory;
+      for (i = 0; i < ncols; i++)
+        if (cols[i].type == 0)
+          cols[i].type = 's';  /* only empty fields seen */
+    }
+  }
+
+  rows = csvpass(&rd, start, maxrows, &cols, &ncols, false);
+  if (rows < 0)
+    goto nomemory;
+  next = (rd.eof && rd.beg >= rd.end ? -1L : rd.base + (long) rd.beg);
+  closefile(rd.f);
+
+  /* build the Nial columns */
+  z = new_create_array(atype, 1, 0, &ncols);
+  for (i = 0; i < ncols; i++) {
+    csvcol     *c = &cols[i];
+    nialptr     col;
+
+    if (c->type == 'i') {
+      col = new_create_array(inttype, 1, 0, &c->n);
+      if (c->n > 0)
+        memcpy(pfirstint(col), c->ivals, c->n * sizeof(nialint));
+    }
+    else if (c->type == 'r') {
+      col = new_create_array(realtype, 1, 0, &c->n);
+      if (c->n > 0)
+        memcpy(pfirstreal(col), c->rvals, c->n * sizeof(double));
+    }
+    else {
+      col = new_create_array(atype, 1, 0, &c->n);
+      for (j = 0; j < c->n; j++) {
+        nialint     len = c->offs[j + 1] - c->offs[j];
+        nialptr     str = new_create_array(chartype, 1, 0, &len);
+
+        memcpy(pfirstchar(str), c->text + c->offs[j], len);
+        *(pfirstchar(str) + len) = '\0';
+        store_array(col, j, str);
+      }
+    }
+    store_array(z, i, col);
+  }
+  csvfree(&rd, cols, ncols);
+  if (chunked)
+    z = mkapair(z, createint((nialint) next));
+  apush(z);
+  return;
+
+nomemory:
+  closefile(rd.f);
+  csvfree(&rd, cols, ncols);
+  buildfault("readcsv: not enough memory");
+}
+
 /* routine to create file name list and associated file information */
 
 void
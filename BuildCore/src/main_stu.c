@@ -130,6 +130,7 @@ main(int argc, char *memin[], char **envp)
     
   ssizew = 80;      /* default size of output width */
   initmemsize = dfmemsize;
+  maxmemsize = dfmaxmemsize;
   expansion = true;
   sketch = true;
   decor = false;
@@ -215,7 +216,7 @@ main(int argc, char *memin[], char **envp)
 
   /* process command arguments
      the allowed syntax is:
-     [(+|-)size nnnn] [-defs defsfilenm] [-lws wsfilenm]
+     [(+|-)size nnnn] [-maxsize nnnn] [-defs defsfilenm] [-lws wsfilenm]
         [-i] [-h]
    */
     
@@ -239,6 +240,16 @@ main(int argc, char *memin[], char **envp)
       i += 2;
     }
     else
+    if (strcmp(memin[i], "-maxsize") == 0) {
+      if (i + 1 < argc && memin[i+1] != NULL) {
+        /* set the address space reserved for heap growth */
+        maxmemsize = get_memsize(memin[i + 1]);
+        i += 2;
+      }
+      else
+        exit_cover1("missing size after -maxsize option", NC_FATAL);
+    }
+    else
     if (strcmp(memin[i], "-defs") == 0) {
       if (i < argc && memin[i+1] != NULL) {
         /* explicit defs file name given */
@@ -466,6 +477,8 @@ retry: /* start over point for the main loop */
       
       current_env = Null;        /* set to global environment */
       nialexitflag = false;
+      flushfree();               /* finish freeing left by the last input */
+      marktemps();               /* arrays made from here on are temporaries */
    
       if (latentfound) {
           doinglatent = true;
@@ -476,6 +489,9 @@ retry: /* start over point for the main loop */
       
       topstack = (-1);   /* resets the stack */
 
+      if (compactlimit > 0)
+        autocompact();
+
     /* prompt to get inputline
        We use rl_gets so that the input history is available in the top level loop */
       
@@ -722,7 +738,7 @@ static void
 print_syntax()
 {
   fprintf(stderr, "\n"
-  "SYNTAX: nial  [(+|-)size Wssize] [-defs Filename] [-i] [-lws WSName] [-h]\n"
+  "SYNTAX: nial  [(+|-)size Wssize] [-maxsize Wssize] [-defs Filename] [-i] [-lws WSName] [-h]\n"
   "\n"
   "-size Wssize\n"
   "      Begin with a workspace size of Wssize words. A suffix of G, M or K\n"
@@ -730,6 +746,10 @@ print_syntax()
   "      The workspace expands if space is available.\n"
   "+size Wssize\n"
   "      Fix the workspace size at Wssize words with no expansion.\n"
+  "-maxsize Wssize\n"
+  "      Reserve address space for Wssize words at startup so that the\n"
+  "      workspace grows in place up to that size. Beyond it the workspace\n"
+  "      is copied to a larger area.\n"
   "-defs Filename\n"
   "      After loading the initial workspace the file Filename.ndf\n"
   "      is loaded and executed without displaying input lines.\n"
@@ -782,8 +802,9 @@ cleanup_ws()
     /* cleanup common to all other longjmp calls */
     
     cleardeffiles();           /* clean up open ndf files */
+    cleardefscache();          /* and the definition caches being used */
     clearstack();              /* clear the stack and list of temp arrays */
-    clearheap();               /* remove all arrays with refcnt 0 */
+    cleartemps();              /* remove temporary arrays with refcnt 0 */
     closeuserfiles();          /* close files to avoid interference */
     clear_call_stack();        /* clears names of called routines */
 
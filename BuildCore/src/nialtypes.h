@@ -85,6 +85,9 @@ typedef struct {
 	struct _skv {
 	  char        sk[2];    /* sort flag and kind */
 	  short       val;      /* valence */
+#ifdef INTS64
+	  int         slot;     /* entry in the temporaries log */
+#endif
 	} skv;
 	nialint block_flags;          /* sort, kind, valence */
       } flags;
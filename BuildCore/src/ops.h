@@ -36,3 +36,14 @@ extern void cull(nialptr arr, int diversesw);
 extern int  check_sorted(nialptr x);
    /* trs.c */
 
+/* aggregates computed by groupaggregate */
+#define GROUPCOUNT 0
+#define GROUPSUM   1
+#define GROUPMIN   2
+#define GROUPMAX   3
+#define GROUPMEAN  4
+
+extern int  groupaggregate(nialptr a, nialptr b, int mode, nialptr * keys,
+                           nialptr * aggs);
+   /* used by trs.c */
+
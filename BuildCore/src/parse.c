@@ -66,6 +66,7 @@
 #include "fileio.h"          /* for nprintf */
 #include "ops.h"             /* for append hitch */
 #include "if.h"              /* for checksignal */
+#include "compare.h"         /* for arrayhash, equalitem */
 
 
 
@@ -139,6 +140,7 @@ static nialint  FOR_EXPR(nialptr * tree);
 static nialint  IF_EXPR(nialptr * tree);
 static void ite_cleanup(int cnt);
 static nialint  CASE_EXPR(nialptr * tree);
+static nialptr caseindex(nialptr vals);
 
 /* the DEBUG version of error shows an error no so we can determine which call
    to error produced it, while the production version omits it.
@@ -3894,7 +3896,7 @@ CASE_EXPR(nialptr * tree)
     }
 
     accept1(); /* accept the ENDCASE, build the parse tree */
-    *tree = b_caseexpr(t1, clistvals, clist, slist);
+    *tree = b_caseexpr(t1, clistvals, clist, slist, caseindex(clistvals));
     return (SUCCEED);
   }
 
@@ -3907,6 +3909,84 @@ CASE_EXPR(nialptr * tree)
   return (ERROR);
 }
 
+/* caseindex builds the dispatch index for a CASE expression with the
+   selector values vals, so that eval can select the branch without
+   comparing the test value with each selector in turn. Integer selectors
+   spanning a small range get a dense index; any other selectors are
+   hashed with arrayhash, which is consistent with equal. A repeated
+   selector keeps its first branch, as in the scan. Returns Null if there
+   are too few selectors for an index to pay. See parse.h for the layout. */
+
+static      nialptr
+caseindex(nialptr vals)
+{
+  nialint     n = tally(vals),
+              lo,
+              hi,
+              v,
+              i,
+              h,
+              g,
+              size,
+              mask;
+  nialptr     z;
+  int         dense = true;
+
+  if (n < CASEINDEXMIN)
+    return (Null);
+  lo = hi = 0;
+  for (i = 0; i < n && dense; i++) {
+    nialptr     x = fetchasarray(vals, i);
+
+    if (kind(x) != inttype || !atomic(x))
+      dense = false;
+    else {
+      v = intval(x);
+      if (i == 0 || v < lo)
+        lo = v;
+      if (i == 0 || v > hi)
+        hi = v;
+    }
+    freeup(x);
+  }
+  if (dense && (unialint) hi - (unialint) lo < (unialint) (2 * n + 8)) {
+    size = hi - lo + 3;
+    z = new_create_array(inttype, 1, 0, &size);
+    store_int(z, 0, CASEDENSE);
+    store_int(z, 1, lo);
+    for (i = 2; i < size; i++)
+      store_int(z, i, n);    /* selects the ELSE branch */
+    for (i = n - 1; i >= 0; i--) {  /* in reverse so the first one wins */
+      nialptr     x = fetchasarray(vals, i);
+
+      store_int(z, intval(x) - lo + 2, i);
+      freeup(x);
+    }
+    return (z);
+  }
+  size = 16;
+  while (size < 2 * n)
+    size *= 2;
+  mask = size - 1;
+  size += 2;
+  z = new_create_array(inttype, 1, 0, &size);
+  store_int(z, 0, CASEHASH);
+  store_int(z, 1, mask);
+  for (i = 2; i < size; i++)
+    store_int(z, i, -1);
+  for (i = 0; i < n; i++) {
+    nialptr     x = fetchasarray(vals, i);
+
+    h = arrayhash(x) & mask;
+    while ((g = fetch_int(z, h + 2)) >= 0 && !equalitem(vals, g, x))
+      h = (h + 1) & mask;
+    if (g < 0)
+      store_int(z, h + 2, i);
+    freeup(x);
+  }
+  return (z);
+}
+
 /* a comment is a "%" followed by text up unyil a ";".
    It is scanned as a single token. 
 */
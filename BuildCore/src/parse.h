@@ -68,6 +68,16 @@
 #define t_tokenstream 99
 #define t_parsetree 100
 
+/* kinds of dispatch index stored with a CASE expression.
+   A dense index is the integer list CASEDENSE, lo, followed by the
+   branch number for each selector value from lo upward.
+   A hashed index is CASEHASH, mask, followed by a table of mask+1 slots
+   holding a branch number or -1, probed linearly from arrayhash. */
+
+#define CASEDENSE 0
+#define CASEHASH 1
+#define CASEINDEXMIN 4  /* fewer selectors are scanned in turn */
+
 
 extern void parse(int act_only);
 
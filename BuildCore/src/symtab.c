@@ -130,7 +130,9 @@ static nialint defcnt;
  A symbol table has four fields
      - the root of the binary tree (set to grounded on creation)
      - a pointer to the current activation record in the stack
-       for local environments (set to -1 on creation)
+       for local environments (set to -1 on creation). It is held in
+       an integer atom belonging to the table that store_sp updates in
+       place. createint gives a new atom for -1.
      - a property field that indicates whether the symbol table
        is global or local, and if it is local whether it is open, 
        closed or a parameter table
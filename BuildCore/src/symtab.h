@@ -41,7 +41,6 @@
 #define get_root(sym)  fetch_array(sym,0)
 #define get_symtabname(sym) fetch_array(sym,3)
 #define get_spval(sym) intval(fetch_array(sym,1))
-#define get_sp(sym)    fetch_array(sym,1)
 #define symprop(sym)   intval(fetch_array(sym,2))
 #define set_symtabname(sym,name)   replace_array(sym,3,name)
 #define replace_symprop(sym,prop)  replace_array(sym,2,createint(prop))
@@ -51,7 +50,9 @@
 /* symbol table record defines */
 
 #define store_root(sym,val) replace_array(sym,0,val)
-#define store_sp(sym,sp) replace_array(sym,1,sp)
+/* the stack pointer is kept in an integer atom owned by the symbol table
+   and is updated in place, so that entering a scope does not create one */
+#define store_sp(sym,sp) (*pfirstint(fetch_array(sym,1)) = (sp))
 #define st_symprop(sym,prop) replace_array(sym,2,createint((nialint)prop))
 
 /* symbol table properties */
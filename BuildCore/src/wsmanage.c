@@ -64,6 +64,15 @@
 
 
 static int  allwhitespace(char *x);
+static void dounit(int mode, int *errorsfound);
+static int  sourcekey(FILE * f, nialint * len, unialint * hash);
+static void cachename(char *fname, char *cname);
+static char *readdefscache(char *cname, nialint len, unialint hash,
+                           nialint * nunits);
+static void cacheput(void *p, size_t n);
+static void cacheunit(nialptr ts);
+static void writedefscache(char *cname, nialint len, unialint hash);
+static void popdefscache(void);
 
 
 /* this set of routines manages workspace saving and loading.
@@ -88,6 +97,8 @@ wsdump(FILE * f1)
               next;
   nialint     cnt;
 
+  flushfree();               /* so no queued array is saved */
+
   /* find the address of the highest free block */
   highest = freelisthdr,
   next = freelisthdr;
@@ -178,6 +189,9 @@ wsload(FILE * f1)
 
 
 
+  /* finish queued freeing while it still refers to the current heap */
+  flushfree();
+
   /* read global structure */
   testrderr(readblock(f1, (char *) &G, sizeof G, false, 0L, 0));
 
@@ -193,6 +207,9 @@ wsload(FILE * f1)
     }
   }
 
+  /* the blocks in the temporaries log are about to be overwritten */
+  marktemps();
+
   /* set the link to the first free block */
   fwdlink(freelisthdr) = firstfree;
 
@@ -435,6 +452,64 @@ iloaddefs(void)
 
 #include "defstbl.h"
 
+/* Compiled definition files.
+
+   A silent loaddefs of a file keeps the scanned form of the file in a
+   cache file beside it with the extension .ndc. A later load of the
+   unchanged file reads the token streams from the cache and skips
+   reading the lines and scanning them. The cache holds the token stream
+   of each group of lines that is not a remark. Its header records the
+   cache format, the interpreter version and word size, and the length
+   and a hash of the source text. The source is used, and the cache
+   rewritten, whenever these do not match.
+
+   Parse trees are not kept since they refer to symbol table entries by
+   heap address, and the parse of a group depends on the roles that the
+   global names have when the file is loaded. Tokens depend only on the
+   text.
+
+   A cache is not written if a group fails to scan or the file cannot be
+   created, and is not used for a loaddefs that echoes the source. The
+   operation setdefscache turns the mechanism off or on. */
+
+#define NDCMAGIC   "NialNDC"
+#define NDCFORMAT  1
+#define NDCVERSION nialversion wordsize
+
+struct ndcheader {
+  char        magic[8];
+  char        version[16];
+  nialint     format,
+              srclen,
+              nunits;
+  unialint    srchash;
+};
+
+static int  defscache = true;
+
+/* the cache being built by the current loaddefs. A loaddefs that reads
+   or builds a cache pushes the state of the enclosing one, with the
+   cache it has read, so that cleardefscache can free them all after a
+   jump to top level. */
+
+static char *ndcbuf = NULL;
+static size_t ndclen = 0,
+            ndccap = 0;
+static nialint ndcunits = 0;
+static int  ndcok = false;
+
+struct ndcsave {
+  char       *buf;           /* state of the enclosing loaddefs */
+  size_t      len,
+              cap;
+  nialint     units;
+  int         ok;
+  char       *cache;         /* cache read by this loaddefs */
+  struct ndcsave *prev;
+};
+
+static struct ndcsave *ndcsaved = NULL;
+
 int
 loaddefs(int fromfile, char *fname, int mode)
 {
@@ -446,6 +521,19 @@ loaddefs(int fromfile, char *fname, int mode)
               linecnt;
   FILE       *f1 = NULL;     /* initialized to avoid complaint */
   int         errorsfound;
+  int         usecache = false,
+              buildcache = false;
+  char        cname[GENBUFFERSIZE + 4];
+  char       *cache = NULL,
+             *next;
+  nialint     srclen = 0,
+              nunits = 0,
+              i,
+              j,
+              n,
+              len;
+  unialint    srchash = 0;
+  struct ndcsave *save;
     
   if (fromfile) {
     f1 = openfile(fname, 'r', 't');
@@ -453,6 +541,23 @@ loaddefs(int fromfile, char *fname, int mode)
       return (false);
 
     pushsysfile(f1);
+
+    /* look for a compiled form of the file */
+    if (defscache && mode == 0 && sourcekey(f1, &srclen, &srchash) &&
+        (save = (struct ndcsave *) malloc(sizeof *save)) != NULL) {
+      cachename(fname, cname);
+      cache = readdefscache(cname, srclen, srchash, &nunits);
+      usecache = cache != NULL;
+      buildcache = !usecache;
+      save->buf = ndcbuf;
+      save->len = ndclen;
+      save->cap = ndccap;
+      save->units = ndcunits;
+      save->ok = ndcok;
+      save->cache = cache;
+      save->prev = ndcsaved;
+      ndcsaved = save;
+    }
   }
   /* a loaddefs always affects the global environment. We reset current_env to
      relect this.  The code to restore the environment is below. This must be
@@ -469,6 +574,50 @@ loaddefs(int fromfile, char *fname, int mode)
   repeatloop = true;
   linecnt = 0;
 
+  if (usecache) {
+    /* rebuild each token stream from the cache and process it */
+    next = cache + sizeof(struct ndcheader);
+    for (i = 0; i < nunits; i++) {
+      nialptr     tks;
+
+#ifdef USER_BREAK_FLAG
+      checksignal(NC_CS_NORMAL);
+#endif
+      memcpy(&n, next, sizeof n);
+      next += sizeof n;
+      tks = new_create_array(atype, 1, 0, &n);
+      store_array(tks, 0, createint(t_tokenstream));
+      for (j = 1; j < n; j += 2) {
+        nialint     prop;
+
+        memcpy(&prop, next, sizeof prop);
+        memcpy(&len, next + sizeof prop, sizeof len);
+        next += sizeof prop + sizeof len;
+        store_array(tks, j, createint(prop));
+        store_array(tks, j + 1, makephrase(next));
+        next += len + 1;
+      }
+      apush(tks);
+      dounit(mode, &errorsfound);
+      if (ts != topstack) {
+        while (ts != topstack)
+          freeup(apop());
+        exit_cover1("Stack has grown during loaddefs", NC_FATAL);
+      }
+    }
+    repeatloop = false;
+  }
+  else if (buildcache) {   /* start a cache with room for the header */
+    struct ndcheader blank;
+
+    memset(&blank, 0, sizeof blank);
+    ndcbuf = NULL;
+    ndclen = ndccap = 0;
+    ndcunits = 0;
+    ndcok = true;
+    cacheput(&blank, sizeof blank);
+  }
+
   /* loop to pick up groups of lines */
   while (repeatloop) {      
     /* continue as long as their are line groups */
@@ -546,36 +695,9 @@ loaddefs(int fromfile, char *fname, int mode)
       {                 
         /* carry out the actions of the main loop */
         iscan();
-        parse(true);
-        /* check whether parse produced an error */
-        if (kind(top) == faulttype) {
-          if (top != Nullexpr) {
-            errorsfound++;
-            if (mode == 0) { /* show error message */
-              apush(top);
-              ipicture();
-              show(apop());
-            }
-          }
-        }
-
-        /* evaluate the parse tree, if it is a fault, it is the value returned */
-        ieval();
-
-#ifdef DEBUG
-        memchk();
-#endif
-
-        if (mode) {  /* show the result */
-          if (top != Nullexpr) {
-            ipicture();
-            show(apop());
-          }
-          else
-            apop();          /* the Nullexpr */
-        }
-        else
-          freeup(apop());    /* free because it might not be Nullexpr */
+        if (buildcache)
+          cacheunit(top);
+        dounit(mode, &errorsfound);
       }
 
       if (mode) {            /* now display empty line */
@@ -597,6 +719,13 @@ loaddefs(int fromfile, char *fname, int mode)
     closefile(f1);
     popsysfile();
   }
+  if (buildcache) {
+    if (ndcok)
+      writedefscache(cname, srclen, srchash);
+    free(ndcbuf);
+  }
+  if (usecache || buildcache)
+    popdefscache();
 
   /* restore the current_env */
   current_env = apop();
@@ -606,6 +735,288 @@ loaddefs(int fromfile, char *fname, int mode)
   return (true);
 }
 
+/* routine to parse and evaluate the token stream on the stack for
+   loaddefs, showing the result if mode is true. */
+
+static void
+dounit(int mode, int *errorsfound)
+{
+  parse(true);
+  /* check whether parse produced an error */
+  if (kind(top) == faulttype) {
+    if (top != Nullexpr) {
+      (*errorsfound)++;
+      if (mode == 0) { /* show error message */
+        apush(top);
+        ipicture();
+        show(apop());
+      }
+    }
+  }
+
+  /* evaluate the parse tree, if it is a fault, it is the value returned */
+  ieval();
+
+#ifdef DEBUG
+  memchk();
+#endif
+
+  if (mode) {  /* show the result */
+    if (top != Nullexpr) {
+      ipicture();
+      show(apop());
+    }
+    else
+      apop();          /* the Nullexpr */
+  }
+  else
+    freeup(apop());    /* free because it might not be Nullexpr */
+}
+
+/* routine to compute the length and a hash of the text of the open file f,
+   leaving it positioned at the start. */
+
+static int
+sourcekey(FILE * f, nialint * len, unialint * hash)
+{
+  char        buf[4096];
+  size_t      n,
+              i;
+  unialint    h = 2166136261u;
+
+  *len = 0;
+  while ((n = fread(buf, 1, sizeof buf, f)) > 0) {
+    for (i = 0; i < n; i++)
+      h = (h ^ (unsigned char) buf[i]) * 16777619u;
+    *len += n;
+  }
+  *hash = h;
+  if (ferror(f))
+    return false;
+  rewind(f);
+  return true;
+}
+
+/* routine to form the cache file name by replacing an .ndf extension
+   with .ndc, or by adding .ndc to another extension */
+
+static void
+cachename(char *fname, char *cname)
+{
+  size_t      n = strlen(fname);
+
+  strcpy(cname, fname);
+  if (n > 4 && STRCASECMP(cname + n - 4, ".ndf") == 0)
+    cname[n - 4] = '\0';
+  strcat(cname, ".ndc");
+}
+
+/* routine to read the cache file cname. It returns the contents in
+   allocated space if its header matches the source key and the
+   interpreter and the units it holds are well formed, and NULL
+   otherwise. */
+
+static char *
+readdefscache(char *cname, nialint len, unialint hash, nialint * nunits)
+{
+  FILE       *f;
+  char       *buf;
+  struct stat st;
+  struct ndcheader hdr;
+  char        version[sizeof hdr.version];
+  char       *p,
+             *end;
+  nialint     u,
+              j,
+              n,
+              tlen;
+
+  if (stat(cname, &st) != 0 || st.st_size < (off_t) sizeof hdr)
+    return NULL;
+  f = openfile(cname, 'r', 'b');
+  if (f == OPENFAILED)
+    return NULL;
+  buf = (char *) malloc((size_t) st.st_size);
+  if (buf == NULL ||
+      readblock(f, buf, (size_t) st.st_size, false, 0L, 0) != (nialint) st.st_size) {
+    free(buf);
+    closefile(f);
+    return NULL;
+  }
+  closefile(f);
+  memcpy(&hdr, buf, sizeof hdr);
+  memset(version, 0, sizeof version);
+  strncpy(version, NDCVERSION, sizeof version - 1);
+  if (memcmp(hdr.magic, NDCMAGIC, sizeof NDCMAGIC) != 0 ||
+      memcmp(hdr.version, version, sizeof version) != 0 ||
+      hdr.format != NDCFORMAT || hdr.srclen != len || hdr.srchash != hash)
+    goto bad;
+
+  /* check the units so that a damaged file is not used */
+  p = buf + sizeof hdr;
+  end = buf + st.st_size;
+  for (u = 0; u < hdr.nunits; u++) {
+    if (end - p < (nialint) sizeof n)
+      goto bad;
+    memcpy(&n, p, sizeof n);
+    p += sizeof n;
+    if (n < 1 || n % 2 != 1)
+      goto bad;
+    for (j = 1; j < n; j += 2) {  /* a property and a text length */
+      if (end - p < (nialint) (2 * sizeof tlen))
+        goto bad;
+      memcpy(&tlen, p + sizeof tlen, sizeof tlen);
+      p += 2 * sizeof tlen;
+      if (tlen < 0 || end - p <= tlen || p[tlen] != '\0')
+        goto bad;
+      p += tlen + 1;
+    }
+  }
+  if (p != end)
+    goto bad;
+  *nunits = hdr.nunits;
+  return buf;
+
+bad:
+  free(buf);
+  return NULL;
+}
+
+/* routine to add bytes to the cache being built */
+
+static void
+cacheput(void *p, size_t n)
+{
+  if (!ndcok)
+    return;
+  if (ndclen + n > ndccap) {
+    size_t      newcap = 2 * (ndclen + n);
+    char       *newbuf = (char *) realloc(ndcbuf, newcap);
+
+    if (newbuf == NULL) {
+      ndcok = false;         /* give up on the cache, not the load */
+      return;
+    }
+    ndcbuf = newbuf;
+    ndccap = newcap;
+  }
+  memcpy(ndcbuf + ndclen, p, n);
+  ndclen += n;
+}
+
+/* routine to add a token stream to the cache being built. A fault from
+   the scanner, or an item that is not a token, stops the cache from
+   being written. */
+
+static void
+cacheunit(nialptr ts)
+{
+  nialint     n = tally(ts),
+              i,
+              prop,
+              len;
+
+  if (kind(ts) != atype || n % 2 != 1) {
+    ndcok = false;
+    return;
+  }
+  cacheput(&n, sizeof n);
+  for (i = 1; i < n; i += 2) {
+    nialptr     p = fetch_array(ts, i),
+                s = fetch_array(ts, i + 1);
+
+    if (kind(p) != inttype || valence(p) != 0 || kind(s) != phrasetype) {
+      ndcok = false;
+      return;
+    }
+    prop = intval(p);
+    len = tknlength(s);
+    cacheput(&prop, sizeof prop);
+    cacheput(&len, sizeof len);
+    cacheput(pfirstchar(s), (size_t) len + 1);
+  }
+  ndcunits++;
+}
+
+/* routine to write the cache built by loaddefs. Failure to write it,
+   for instance in a read only directory, is not an error. */
+
+static void
+writedefscache(char *cname, nialint len, unialint hash)
+{
+  FILE       *f;
+  struct ndcheader hdr;
+
+  memset(&hdr, 0, sizeof hdr);
+  memcpy(hdr.magic, NDCMAGIC, sizeof NDCMAGIC);
+  strncpy(hdr.version, NDCVERSION, sizeof hdr.version - 1);
+  hdr.format = NDCFORMAT;
+  hdr.srclen = len;
+  hdr.nunits = ndcunits;
+  hdr.srchash = hash;
+  memcpy(ndcbuf, &hdr, sizeof hdr);
+  f = openfile(cname, 'w', 'b');
+  if (f == OPENFAILED)
+    return;
+  if (writeblock(f, ndcbuf, ndclen, false, 0L, 0) == IOERR) {
+    closefile(f);
+    remove(cname);           /* do not leave a partial cache */
+    return;
+  }
+  closefile(f);
+}
+
+/* routine to implement the operation setdefscache. setdefscache o stops
+   loaddefs from reading and writing .ndc files, setdefscache l turns
+   them back on. The old setting is returned. */
+
+void
+isetdefscache(void)
+{
+  nialptr     x = apop();
+  int         old = defscache;
+
+  if (!atomic(x) || kind(x) != booltype) {
+    apush(makefault("?setdefscache expects a boolean"));
+    freeup(x);
+    return;
+  }
+  defscache = boolval(x);
+  apush(createbool(old));
+  freeup(x);
+}
+
+/* routine to free the cache read by the innermost loaddefs and restore
+   the cache state of the enclosing one */
+
+static void
+popdefscache(void)
+{
+  struct ndcsave *save = ndcsaved;
+
+  free(save->cache);
+  ndcbuf = save->buf;
+  ndclen = save->len;
+  ndccap = save->cap;
+  ndcunits = save->units;
+  ndcok = save->ok;
+  ndcsaved = save->prev;
+  free(save);
+}
+
+/* routine to free the caches of loaddefs calls cut short by a jump to
+   top level. Called from cleanup_ws. */
+
+void
+cleardefscache(void)
+{
+  while (ndcsaved != NULL) {
+    if (ndcbuf != ndcsaved->buf)  /* built by the innermost loaddefs */
+      free(ndcbuf);
+    popdefscache();
+  }
+}
+
 /* support routine to check if a line is all white space */
 
 static int
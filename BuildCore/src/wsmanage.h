@@ -19,4 +19,5 @@ extern void wsdump(FILE * f1);
 extern void wsload(FILE * f1);
 extern void check_ext(char *str, char *ext,int force);
 extern int  loaddefs(int fromfile, char *fname, int mode);
+extern void cleardefscache(void);
 
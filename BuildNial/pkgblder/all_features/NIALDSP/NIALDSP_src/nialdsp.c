@@ -79,6 +79,201 @@
 #include <math.h>
 
 
+/* filters with at least this many taps use FFT convolution */
+#define DSP_FFT_TAPS 64
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+
+/**
+ * Dot product of two vectors. Four independent partial sums let the
+ * compiler keep the loop in vector registers without relaxing the
+ * floating point rules.
+ */
+static double dsp_dot(double *p, double *q, nialint m)
+{
+   double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+   nialint j;
+
+   for (j = 0; j + 4 <= m; j += 4) {
+      s0 += p[j]*q[j];
+      s1 += p[j+1]*q[j+1];
+      s2 += p[j+2]*q[j+2];
+      s3 += p[j+3]*q[j+3];
+   }
+   for (; j < m; j++)
+      s0 += p[j]*q[j];
+
+   return (s0 + s1) + (s2 + s3);
+}
+
+
+/**
+ * In-place radix 2 FFT of n complex values stored as re,im pairs.
+ * w holds the n/2 forward twiddle factors. The inverse transform
+ * uses their conjugates and is not scaled.
+ */
+static void dsp_fft(double *z, nialint n, double *w, int inverse)
+{
+   nialint i, j, k, len;
+
+   /* bit reversal permutation */
+   for (i = 1, j = 0; i < n; i++) {
+      nialint bit = n >> 1;
+
+      for (; j & bit; bit >>= 1)
+         j ^= bit;
+      j ^= bit;
+      if (i < j) {
+         double t;
+         t = z[2*i];   z[2*i]   = z[2*j];   z[2*j]   = t;
+         t = z[2*i+1]; z[2*i+1] = z[2*j+1]; z[2*j+1] = t;
+      }
+   }
+
+   for (len = 2; len <= n; len <<= 1) {
+      nialint half = len/2, step = n/len;
+
+      for (i = 0; i < n; i += len) {
+         for (k = 0; k < half; k++) {
+            double *u = z + 2*(i+k), *v = u + 2*half;
+            double wr = w[2*k*step];
+            double wi = (inverse ? -w[2*k*step+1] : w[2*k*step+1]);
+            double tr = v[0]*wr - v[1]*wi;
+            double ti = v[0]*wi + v[1]*wr;
+
+            v[0] = u[0] - tr;
+            v[1] = u[1] - ti;
+            u[0] += tr;
+            u[1] += ti;
+         }
+      }
+   }
+}
+
+
+/**
+ * FIR part by overlap-save FFT convolution. The arguments are as for
+ * dsp_fir. Each transform is the size of at least 4 filters so that
+ * most of each block is output. Since the signal and the filter are
+ * real, two blocks are carried in the real and imaginary parts of
+ * one transform.
+ * Returns 0 if the work space cannot be allocated.
+ */
+static int dsp_fir_fft(double *y, double *x, nialint n, double *c, nialint m)
+{
+   nialint L = 1, B, i, k;
+   double *H, *z, *w;
+
+   while (L < 4*m)
+      L <<= 1;
+   B = L - m + 1;
+
+   H = (double *)malloc((5*L)*sizeof(double));
+   if (H == NULL)
+      return 0;
+   z = H + 2*L;
+   w = z + 2*L;
+
+   for (k = 0; k < L/2; k++) {
+      w[2*k]   = cos(-2.0*M_PI*k/L);
+      w[2*k+1] = sin(-2.0*M_PI*k/L);
+   }
+
+   /* transform of the impulse response, scaled for the inverse */
+   for (k = 0; k < L; k++) {
+      H[2*k]   = (k < m ? c[m-1-k]/L : 0.0);
+      H[2*k+1] = 0.0;
+   }
+   dsp_fft(H, L, w, 0);
+
+   for (i = 0; i < n; i += 2*B) {
+      /* block i covers x(i-m+1) ... x(i+B-1), the next block is B on */
+      for (k = 0; k < L; k++) {
+         nialint ia = i - m + 1 + k, ib = ia + B;
+
+         z[2*k]   = (ia < n ? x[ia] : 0.0);
+         z[2*k+1] = (ib < n ? x[ib] : 0.0);
+      }
+
+      dsp_fft(z, L, w, 0);
+      for (k = 0; k < L; k++) {
+         double zr = z[2*k], zi = z[2*k+1];
+
+         z[2*k]   = zr*H[2*k] - zi*H[2*k+1];
+         z[2*k+1] = zr*H[2*k+1] + zi*H[2*k];
+      }
+      dsp_fft(z, L, w, 1);
+
+      /* the first m-1 outputs of each block wrap around and are discarded */
+      for (k = m - 1; k < L; k++) {
+         nialint ja = i + k - m + 1, jb = ja + B;
+
+         if (ja < n)
+            y[ja] = z[2*k];
+         if (jb < n)
+            y[jb] = z[2*k+1];
+      }
+   }
+
+   free(H);
+   return 1;
+}
+
+
+/**
+ * FIR part of a filter
+ *
+ *    y(i) = c(0)x(i-m+1) + ... + c(m-1)x(i)   for 0 <= i < n
+ *
+ * c holds the m filter coefficients in reverse order and x must have
+ * m-1 valid samples before x(0). Long filters use FFT convolution.
+ */
+static void dsp_fir(double *y, double *x, nialint n, double *c, nialint m)
+{
+   nialint i;
+
+   if (m >= DSP_FFT_TAPS && n >= m && dsp_fir_fft(y, x, n, c, m))
+      return;
+
+   for (i = 0; i < n; i++)
+      y[i] = dsp_dot(x + i - m + 1, c, m);
+}
+
+
+/**
+ * Run a filter over n samples. The normalised coefficients a (with
+ * a(0) = 1) and b are in their natural order. x must have nb-1
+ * samples of input history before x(0) and y must have na-1 samples
+ * of output history before y(0). c is work space for max(na,nb)
+ * values.
+ */
+static void dsp_run(double *y, double *x, nialint n, double *a, nialint na,
+                    double *b, nialint nb, double *c)
+{
+   nialint i, j;
+
+   /* the convolution involving x and b */
+   if (nb == 0)
+      memcpy(y, x, n*sizeof(double));
+   else {
+      for (j = 0; j < nb; j++)
+         c[j] = b[nb-1-j];
+      dsp_fir(y, x, n, c, nb);
+   }
+
+   /* the feedback computation involving y and a without a(0) */
+   if (na > 1) {
+      for (j = 0; j < na - 1; j++)
+         c[j] = a[na-1-j];
+      for (i = 0; i < n; i++)
+         y[i] -= dsp_dot(y + i - na + 1, c, na - 1);
+   }
+}
+
+
 /**
  * Y = _dspFilter A B X
  * 
@@ -98,18 +293,16 @@
  *  If tally A is 1 then there is no feedback and the
  *  second part is avoided.
  *
- *  If tally B is 0 then the first part is avoided. This is to
- *  allow the first part to be replaced by an FFT convolution.
+ *  If tally B is 0 then the first part is avoided. When B has at
+ *  least DSP_FFT_TAPS entries the first part uses FFT convolution.
  *  
  */
 void idsp_filter(void) {
    nialptr x = apop();
    nialptr a, b, d;
-   nialint i;
+   nialint i, na, nb, n, clen, worklen;
    nialptr res, work;
-   nialint worklen, reslen, clen;
-   double *wptr, *cptr, *dptr;
-   double *p, *q, *r;
+   double *an, *bn, *cptr, *xptr, *yptr;
    double a0;
    
    if (kind(x) != atype || tally(x) != 3) {
@@ -131,114 +324,206 @@ void idsp_filter(void) {
    }
    
    /*
-    * We create a work array divided into 3 zones.
-    *   Zone 1 is for the coefficient arrays
-    *   Zone 2 is a zero padded area for non-existent x(n) or y(n)
-    *   Zone 3 holds X  or Y in the computation
+    * We create a work array divided into 4 zones.
+    *   Zone 1 holds the normalised A and B coefficients
+    *   Zone 2 is for the reversed coefficients
+    *   Zone 3 is zero padding followed by X
+    *   Zone 4 is zero padding followed by Y
     */
    
-   reslen  = tally(d);
-   clen    = (tally(a) > tally(b))? tally(a): tally(b);
-   worklen = reslen + 2*clen;
+   na      = tally(a);
+   nb      = tally(b);
+   n       = tally(d);
+   clen    = (na > nb)? na: nb;
+   worklen = na + nb + clen + 2*(clen + n);
    work    = new_create_array(realtype, 1, 0, &worklen);
    res     = new_create_array(realtype, valence(d), 0, shpptr(d, valence(d)));
 
    /* Set up zone pointers */
-   cptr = pfirstreal(work);     /* Coefficients */
-   wptr = cptr + clen;          /* Padding      */
-   dptr = wptr + clen;          /* Data         */
+   an   = pfirstreal(work);
+   bn   = an + na;
+   cptr = bn + nb;
+   xptr = cptr + 2*clen;
+   yptr = xptr + n + clen;
 
-   /* Copy the supplied X into the data area */
-   memcpy(dptr, pfirstreal(d), tally(d)*sizeof(double));
-
-   /* Get the normalising coefficient */
+   /* Normalise the coefficients */
    a0 = fetch_real(a, 0);
+   for (i = 0; i < na; i++)
+      an[i] = fetch_real(a, i)/a0;
+   for (i = 0; i < nb; i++)
+      bn[i] = fetch_real(b, i)/a0;
 
-   /* Initialise the padding */
-   for (i = 0, p = wptr; i < clen; i++)
-      *p++ = 0.0;
-   
-   /* Avoid the impulse response convolution if B is Null */
-   if (tally(b) == 0) {
-      /*
-      * Copy the X values directly to the output to set up for
-      * the second pass
-      */
-      memcpy(pfirstreal(res), pfirstreal(d), tally(d)*sizeof(double));
-      goto second_pass;
+   /* Initialise the padding and copy the supplied X into the data area */
+   for (i = 0; i < clen; i++)
+      xptr[i-clen] = yptr[i-clen] = 0.0;
+   memcpy(xptr, pfirstreal(d), n*sizeof(double));
+
+   dsp_run(yptr, xptr, n, an, na, bn, nb, cptr);
+   memcpy(pfirstreal(res), yptr, n*sizeof(double));
+
+   freeup(work);
+   apush(res);
+   freeup(x);
+   return;
+}
+
+
+/* Use a phrase as the indicator of a filter state */
+#define DSP_STATE_FLAG "DSPSTATE8817293305"
+#define DSP_STATE_SIZE 5
+
+static nialptr dsp_state_flag(void)
+{
+   static nialptr flag = invalidptr;
+
+   if (flag == invalidptr) {
+      flag = makephrase(DSP_STATE_FLAG);
+      incrrefcnt(flag);
    }
-     
-     
-   /* ----------- Convolution involving x and b ---------------------- */
+   return flag;
+}
 
-   /*
-   * Flip the values of the normalised B vector
-   * into the coefficient area
-   */   
-   for (i = 0, p = cptr + tally(b), q = pfirstreal(b); i < tally(b); i++)
-      *--p = *q++/a0;
-   
-   /* Perform the convolution */
-   r = pfirstreal(res);
-   wptr = dptr - tally(b) + 1;
-   for (i = 0; i < tally(d); i++) {
-        nialint j;
-        double y_n = 0.0;
-        p = wptr;
-        q = cptr;
-        for (j = 0; j < tally(b); j++) {
-            y_n += (*p++)*(*q++);
-        }
-        
-        /* store the output in the Y vector and slide the input signal */
-        *r++ = y_n;
-        wptr++;
+#define isdspstate(x) (kind(x) == atype && tally(x) == DSP_STATE_SIZE && fetch_array(x, 0) == dsp_state_flag())
+
+
+/**
+ * S = _dspState A B
+ *
+ * Creates a filter state for filtering a long signal in blocks with
+ * _dspStream. The state holds the normalised A and B coefficients and
+ * the last input and output samples of the previous block,
+ *
+ *    [flag, A/a(0), B/a(0), X history, Y history]
+ *
+ * The history starts as zeros. A must not be empty.
+ */
+void idsp_state(void) {
+   nialptr x = apop();
+   nialptr a, b, res, an, bn, xh, yh;
+   nialint i, na, nb, nxh, nyh;
+   double a0;
+
+   if (kind(x) != atype || tally(x) != 2) {
+    apush(makefault("?args"));
+    freeup(x);
+    return;
    }
 
-   /* Avoid second pass if not required */   
-   if (tally(a) == 1)
-      goto return_result;
-    
-second_pass:
+   a = fetch_array(x, 0);
+   b = fetch_array(x, 1);
 
-   /*
-   * The second pass is a feedback computation involving Y and A (without a(0))
-   */
+   if (kind(a) != realtype || (kind(b) != realtype && tally(b) > 0)) {
+    apush(makefault("?arg_types"));
+    freeup(x);
+    return;
+   }
 
-   /* Copy the Y values back into the work zone for feedback */ 
-   memcpy(dptr, pfirstreal(res), tally(d)*sizeof(double));
-   
-   /* 
-    * Flip the normalised A coefficients into the coefficient area.
-    * We only collect coefficients 
-    */
-   for (i = 0, p = cptr + tally(a), q = pfirstreal(a); i < tally(a); i++)
-      *--p = *q++/a0;
-   
-   /* Compute Y values with feedback */
-   r = pfirstreal(res);
-   wptr = dptr - tally(a) + 2;
-   
-   for (i = 0; i < tally(d) - 1; i++) {
-        nialint j;
-        double y_n = *++r;      /* Initial y(n) value */
-        p = wptr;
-        q = cptr;
-        for (j = 0; j < tally(a) - 1; j++) {
-            y_n -= (*p++)*(*q++);
-        }
-        
-        /* Store y(n) into output */
-        *r = y_n;
-        
-        /* Update work area with new y(n) for feedback */
-        *p = y_n;
-        
-        /* Slide the output up */
-        wptr++;
+   /* a(0) is needed to normalise the coefficients */
+   if (tally(a) == 0) {
+    apush(makefault("?dspstate needs A coefficients"));
+    freeup(x);
+    return;
    }
-   
-return_result:
+
+   na  = tally(a);
+   nb  = tally(b);
+   nxh = (nb > 0 ? nb - 1 : 0);
+   nyh = na - 1;
+   an  = new_create_array(realtype, 1, 0, &na);
+   bn  = new_create_array(realtype, 1, 0, &nb);
+   xh  = new_create_array(realtype, 1, 0, &nxh);
+   yh  = new_create_array(realtype, 1, 0, &nyh);
+
+   a0 = fetch_real(a, 0);
+   for (i = 0; i < na; i++)
+      store_real(an, i, fetch_real(a, i)/a0);
+   for (i = 0; i < nb; i++)
+      store_real(bn, i, fetch_real(b, i)/a0);
+   for (i = 0; i < nxh; i++)
+      store_real(xh, i, 0.0);
+   for (i = 0; i < nyh; i++)
+      store_real(yh, i, 0.0);
+
+   i = DSP_STATE_SIZE;
+   res = new_create_array(atype, 1, 0, &i);
+   store_array(res, 0, dsp_state_flag());
+   store_array(res, 1, an);
+   store_array(res, 2, bn);
+   store_array(res, 3, xh);
+   store_array(res, 4, yh);
+
+   apush(res);
+   freeup(x);
+   return;
+}
+
+
+/**
+ * Y = S _dspStream X
+ *
+ * Filters the next block X of a signal with the filter state S from
+ * _dspState. The result is the same as filtering the whole signal
+ * with _dspFilter. The history in S is replaced by the last samples
+ * of this block.
+ */
+void idsp_stream(void) {
+   nialptr x = apop();
+   nialptr s, d, an, bn, res, work, nxh, nyh;
+   nialint na, nb, n, clen, lxh, lyh, worklen;
+   double *cptr, *xptr, *yptr;
+
+   if (kind(x) != atype || tally(x) != 2) {
+    apush(makefault("?args"));
+    freeup(x);
+    return;
+   }
+
+   s = fetch_array(x, 0);
+   d = fetch_array(x, 1);
+
+   if (!isdspstate(s)) {
+    apush(makefault("?dspstream needs a filter state"));
+    freeup(x);
+    return;
+   }
+   if (kind(d) != realtype) {
+    apush(makefault("?arg_types"));
+    freeup(x);
+    return;
+   }
+
+   an   = fetch_array(s, 1);
+   bn   = fetch_array(s, 2);
+   na   = tally(an);
+   nb   = tally(bn);
+   n    = tally(d);
+   lxh  = tally(fetch_array(s, 3));
+   lyh  = tally(fetch_array(s, 4));
+   clen = (na > nb)? na: nb;
+
+   /* work holds the reversed coefficients then history and X, history and Y */
+   worklen = clen + lxh + n + lyh + n;
+   work = new_create_array(realtype, 1, 0, &worklen);
+   nxh  = new_create_array(realtype, 1, 0, &lxh);
+   nyh  = new_create_array(realtype, 1, 0, &lyh);
+   res  = new_create_array(realtype, valence(d), 0, shpptr(d, valence(d)));
+
+   cptr = pfirstreal(work);
+   xptr = cptr + clen + lxh;
+   yptr = xptr + n + lyh;
+
+   memcpy(xptr - lxh, pfirstreal(fetch_array(s, 3)), lxh*sizeof(double));
+   memcpy(xptr, pfirstreal(d), n*sizeof(double));
+   memcpy(yptr - lyh, pfirstreal(fetch_array(s, 4)), lyh*sizeof(double));
+
+   dsp_run(yptr, xptr, n, pfirstreal(an), na, pfirstreal(bn), nb, cptr);
+   memcpy(pfirstreal(res), yptr, n*sizeof(double));
+
+   /* the new history is the end of the extended X and Y */
+   memcpy(pfirstreal(nxh), xptr + n - lxh, lxh*sizeof(double));
+   memcpy(pfirstreal(nyh), yptr + n - lyh, lyh*sizeof(double));
+   replace_array(s, 3, nxh);
+   replace_array(s, 4, nyh);
 
    freeup(work);
    apush(res);
@@ -333,21 +618,7 @@ void idsp_filter2(void) {
       *--p = *q++/a0;
    
    /* Perform the convolution */
-   r = pfirstreal(res);
-   wptr = dptr - tally(b) + 1;
-   for (i = 0; i < tally(d); i++) {
-        nialint j;
-        double y_n = 0.0;
-        p = wptr;
-        q = cptr;
-        for (j = 0; j < tally(b); j++) {
-            y_n += (*p++)*(*q++);
-        }
-        
-        /* store the output in the Y vector and slide the input signal */
-        *r++ = y_n;
-        wptr++;
-   }
+   dsp_fir(pfirstreal(res), dptr, tally(d), cptr, tally(b));
 
    /* Avoid second pass if not required */   
    if (tally(a) == 1)
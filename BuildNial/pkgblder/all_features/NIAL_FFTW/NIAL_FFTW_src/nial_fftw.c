@@ -79,75 +79,498 @@
 
 
 
-void ifft_forward(void) {
+/**
+ * Complex data is held in a real array whose last axis has length 2
+ * for the real and imaginary parts. For compatibility a vector of
+ * even length is also taken as interleaved complex values.
+ *
+ * Plans are cached by transform kind, direction, dimensions and batch
+ * count, each with its own aligned input and output buffers, so a
+ * transform of a size that has been seen before only copies the data
+ * in and out. At most FFT_MAXPLANS plans are kept, the least recently
+ * used being destroyed to make room. The cache is emptied by _fft_clear
+ * and when _fft_effort changes the planning effort.
+ */
+
+#define FFT_C2C 0
+#define FFT_R2C 1
+#define FFT_C2R 2
+
+#define FFT_MAXRANK 16
+#define FFT_MAXPLANS 32
+
+typedef struct fft_plan_entry {
+    int         kind;                 /* FFT_C2C, FFT_R2C or FFT_C2R */
+    int         sign;                 /* direction for FFT_C2C */
+    int         rank;
+    int         dims[FFT_MAXRANK];    /* logical transform dimensions */
+    int         howmany;              /* number of transforms in a batch */
+    nialint     insize, outsize;      /* buffer sizes in doubles */
+    double      *in, *out;
+    fftw_plan   plan;
+    struct fft_plan_entry *next;
+} fft_plan_entry;
+
+static fft_plan_entry *fft_plans = NULL;
+static int  fft_nplans = 0;
+
+/* planner flags used for new plans, set by _fft_effort */
+static unsigned fft_flags = FFTW_ESTIMATE;
+
+
+/**
+ * Release a plan and its buffers.
+ */
+static void fft_free_plan(fft_plan_entry *e)
+{
+    fftw_destroy_plan(e->plan);
+    fftw_free(e->in);
+    fftw_free(e->out);
+    free(e);
+}
+
+
+/**
+ * Empty the plan cache, returning the number of plans released.
+ */
+static nialint fft_free_plans(void)
+{
+    nialint n = 0;
+    fft_plan_entry *e;
+
+    while ((e = fft_plans) != NULL) {
+        fft_plans = e->next;
+        fft_free_plan(e);
+        n++;
+    }
+    fft_nplans = 0;
+    return n;
+}
+
+
+/**
+ * Return a cached plan, creating it and its buffers if needed.
+ * The most recently used plan is moved to the front of the list.
+ */
+static fft_plan_entry *fft_get_plan(int kind, int sign, int rank, int *dims, int howmany)
+{
+    fft_plan_entry *e, **prev;
+    nialint i, nreal = 1, ncomplex;
+
+    for (prev = &fft_plans; (e = *prev) != NULL; prev = &e->next) {
+        if (e->kind == kind && e->sign == sign && e->rank == rank && e->howmany == howmany &&
+            memcmp(e->dims, dims, rank*sizeof(int)) == 0) {
+            *prev = e->next;
+            e->next = fft_plans;
+            fft_plans = e;
+            return e;
+        }
+    }
+
+    for (i = 0; i < rank; i++)
+        nreal *= dims[i];
+    ncomplex = (kind == FFT_C2C ? nreal : (nreal/dims[rank-1])*(dims[rank-1]/2 + 1));
+
+    e = (fft_plan_entry *)malloc(sizeof(fft_plan_entry));
+    if (e == NULL)
+        return NULL;
+    e->kind = kind;
+    e->sign = sign;
+    e->rank = rank;
+    e->howmany = howmany;
+    memcpy(e->dims, dims, rank*sizeof(int));
+    e->insize  = howmany*(kind == FFT_R2C ? nreal : 2*ncomplex);
+    e->outsize = howmany*(kind == FFT_C2R ? nreal : 2*(kind == FFT_C2C ? nreal : ncomplex));
+    e->in  = (double *)fftw_malloc(e->insize*sizeof(double));
+    e->out = (double *)fftw_malloc(e->outsize*sizeof(double));
+    if (e->in == NULL || e->out == NULL) {
+        fftw_free(e->in);
+        fftw_free(e->out);
+        free(e);
+        return NULL;
+    }
+
+    /* planning with measurement overwrites the buffers, so it is done first */
+    switch (kind) {
+    case FFT_C2C:
+        e->plan = fftw_plan_many_dft(rank, e->dims, howmany,
+                                     (fftw_complex *)e->in, NULL, 1, nreal,
+                                     (fftw_complex *)e->out, NULL, 1, nreal,
+                                     sign, fft_flags);
+        break;
+    case FFT_R2C:
+        e->plan = fftw_plan_many_dft_r2c(rank, e->dims, howmany,
+                                         e->in, NULL, 1, nreal,
+                                         (fftw_complex *)e->out, NULL, 1, ncomplex,
+                                         fft_flags);
+        break;
+    default:
+        e->plan = fftw_plan_many_dft_c2r(rank, e->dims, howmany,
+                                         (fftw_complex *)e->in, NULL, 1, ncomplex,
+                                         e->out, NULL, 1, nreal,
+                                         fft_flags);
+        break;
+    }
+
+    if (e->plan == NULL) {
+        fftw_free(e->in);
+        fftw_free(e->out);
+        free(e);
+        return NULL;
+    }
+
+    /* drop the least recently used plan if the cache is full */
+    if (fft_nplans == FFT_MAXPLANS) {
+        for (prev = &fft_plans; (*prev)->next != NULL; prev = &(*prev)->next)
+            ;
+        fft_free_plan(*prev);
+        *prev = NULL;
+        fft_nplans--;
+    }
+
+    e->next = fft_plans;
+    fft_plans = e;
+    fft_nplans++;
+    return e;
+}
+
+
+/**
+ * Split the argument of a transform primitive into the array and an
+ * optional rank. The argument is either the array or a list of the
+ * array, any other values and the rank. nextra is the number of
+ * values between the array and the rank. Returns 0 for a bad argument.
+ */
+static int fft_args(nialptr x, int nextra, nialptr *a, nialptr *extra, nialint *rank)
+{
+    if (kind(x) == realtype && nextra == 0) {
+        *a = x;
+        *rank = -1;
+        return 1;
+    }
+
+    if (kind(x) != atype || (tally(x) != nextra + 1 && tally(x) != nextra + 2))
+        return 0;
+
+    *a = fetch_array(x, 0);
+    if (nextra > 0)
+        *extra = fetch_array(x, 1);
+    *rank = -1;
+    if (tally(x) == nextra + 2) {
+        nialptr r = fetch_array(x, nextra + 1);
+        if (!isint(r) || intval(r) < 1)
+            return 0;
+        *rank = intval(r);
+    }
+
+    return (kind(*a) == realtype);
+}
+
+
+/**
+ * Work out the transform dimensions from the first v extents of the
+ * shape. The last rank of them are transformed and the others are
+ * batched. A rank of -1 means all of them. Returns 0 if they do not fit.
+ */
+static int fft_dims(nialint *shp, nialint v, nialint rank, int *dims, int *howmany)
+{
+    nialint i;
+
+    if (rank == -1)
+        rank = v;
+    if (rank < 1 || rank > v || rank > FFT_MAXRANK)
+        return 0;
+
+    *howmany = 1;
+    for (i = 0; i < v - rank; i++)
+        *howmany *= shp[i];
+    for (i = 0; i < rank; i++) {
+        if (shp[v - rank + i] < 1)
+            return 0;
+        dims[i] = shp[v - rank + i];
+    }
+
+    return (*howmany > 0);
+}
+
+
+/**
+ * Complex to complex transform in either direction
+ *
+ *    _fft_forward X
+ *    _fft_forward [X, Rank]
+ *
+ * X is complex and the last Rank axes before the real/imaginary axis
+ * are transformed. The transforms over any leading axes are done as
+ * one batch. The result has the shape of X. The backward transform
+ * is not scaled.
+ */
+static void fft_c2c(int sign) {
     nialptr x = apop();
-    fftw_complex *c_in, *c_out;
-    fftw_plan p;
-    nialint ncv;
-    nialptr res;
-    
-    if (kind(x) != realtype || (tally(x) % 2) != 0) {
+    nialptr a, res;
+    nialint rank, v, vlen, *lshp;
+    int dims[FFT_MAXRANK], howmany;
+    fft_plan_entry *e;
+
+    if (!fft_args(x, 0, &a, NULL, &rank)) {
         apush(makefault("?args"));
         freeup(x);
         return;
     }
-    
-    ncv = tally(x)/2;
-    
-    c_in  = (fftw_complex*) fftw_malloc(sizeof(fftw_complex)*ncv);
-    c_out = (fftw_complex*) fftw_malloc(sizeof(fftw_complex)*ncv);
-
-    p = fftw_plan_dft_1d(ncv, c_in, c_out, FFTW_FORWARD, FFTW_ESTIMATE);
-    
-    memcpy(c_in, pfirstreal(x), 2*ncv*sizeof(double));
-    fftw_execute(p);
-    
-    res = new_create_array(realtype, valence(x), 0, shpptr(x, valence(x)));
-    memcpy(pfirstreal(res), c_out, 2*ncv*sizeof(double));
-    
-    fftw_destroy_plan(p);
-    fftw_free(c_in);
-    fftw_free(c_out);
-    
+
+    /* a complex array has v-1 logical axes, an interleaved vector has one */
+    v = valence(a);
+    if (v >= 2 && shpptr(a, v)[v-1] == 2) {
+        lshp = shpptr(a, v);
+        v = v - 1;
+    } else {
+        vlen = tally(a)/2;
+        lshp = &vlen;
+        v = ((tally(a) % 2) == 0 && vlen > 0 ? 1 : 0);
+    }
+
+    if (v == 0 || !fft_dims(lshp, v, rank, dims, &howmany)) {
+        apush(makefault("?args"));
+        freeup(x);
+        return;
+    }
+
+    e = fft_get_plan(FFT_C2C, sign, (rank == -1 ? v : rank), dims, howmany);
+    if (e == NULL) {
+        apush(makefault("?fft plan"));
+        freeup(x);
+        return;
+    }
+
+    memcpy(e->in, pfirstreal(a), e->insize*sizeof(double));
+    fftw_execute(e->plan);
+
+    res = new_create_array(realtype, valence(a), 0, shpptr(a, valence(a)));
+    memcpy(pfirstreal(res), e->out, e->outsize*sizeof(double));
+
     apush(res);
     freeup(x);
     return;
 }
 
 
+void ifft_forward(void) {
+    fft_c2c(FFTW_FORWARD);
+}
+
+
 void ifft_backward(void) {
+    fft_c2c(FFTW_BACKWARD);
+}
+
+
+/**
+ * Real to complex transform
+ *
+ *    _fft_r2c X
+ *    _fft_r2c [X, Rank]
+ *
+ * X is a real array and its last Rank axes are transformed. Only the
+ * non-redundant half of the last axis is returned, so an axis of
+ * length n gives n/2+1 complex values and the result has an extra
+ * real/imaginary axis of length 2.
+ */
+void ifft_r2c(void) {
     nialptr x = apop();
-    fftw_complex *c_in, *c_out;
-    fftw_plan p;
-    nialint ncv;
-    nialptr res;
-    
-    if (kind(x) != realtype || (tally(x) % 2) != 0) {
+    nialptr a, res;
+    nialint rank, v, i, *rshp;
+    int dims[FFT_MAXRANK], howmany;
+    fft_plan_entry *e;
+
+    v = 0;
+    if (!fft_args(x, 0, &a, NULL, &rank) || (v = valence(a)) == 0 ||
+        !fft_dims(shpptr(a, v), v, rank, dims, &howmany)) {
         apush(makefault("?args"));
         freeup(x);
         return;
     }
-    
-    ncv = tally(x)/2;
-    
-    c_in  = (fftw_complex*) fftw_malloc(sizeof(fftw_complex)*ncv);
-    c_out = (fftw_complex*) fftw_malloc(sizeof(fftw_complex)*ncv);
-
-    p = fftw_plan_dft_1d(ncv, c_in, c_out, FFTW_BACKWARD, FFTW_ESTIMATE);
-    
-    memcpy(c_in, pfirstreal(x), 2*ncv*sizeof(double));
-    fftw_execute(p);
-    
-    res = new_create_array(realtype, valence(x), 0, shpptr(x, valence(x)));
-    memcpy(pfirstreal(res), c_out, 2*ncv*sizeof(double));
-    
-    fftw_destroy_plan(p);
-    fftw_free(c_in);
-    fftw_free(c_out);
-    
+
+    e = fft_get_plan(FFT_R2C, 0, (rank == -1 ? v : rank), dims, howmany);
+    if (e == NULL) {
+        apush(makefault("?fft plan"));
+        freeup(x);
+        return;
+    }
+
+    memcpy(e->in, pfirstreal(a), e->insize*sizeof(double));
+    fftw_execute(e->plan);
+
+    /* the result shape is the shape of X with the last axis halved, then 2 */
+    rshp = (nialint *)malloc((v + 1)*sizeof(nialint));
+    if (rshp == NULL) {
+        apush(makefault("?memory"));
+        freeup(x);
+        return;
+    }
+    for (i = 0; i < v; i++)
+        rshp[i] = shpptr(a, v)[i];
+    rshp[v-1] = rshp[v-1]/2 + 1;
+    rshp[v] = 2;
+    res = new_create_array(realtype, v + 1, 0, rshp);
+    free(rshp);
+    memcpy(pfirstreal(res), e->out, e->outsize*sizeof(double));
+
+    apush(res);
+    freeup(x);
+    return;
+}
+
+
+/**
+ * Complex to real transform, the inverse of _fft_r2c
+ *
+ *    _fft_c2r [X, N]
+ *    _fft_c2r [X, N, Rank]
+ *
+ * X is complex as returned by _fft_r2c and N is the length of the
+ * last real axis, which has N/2+1 complex values in X. The result is
+ * not scaled.
+ */
+void ifft_c2r(void) {
+    nialptr x = apop();
+    nialptr a, n, res;
+    nialint rank, v, va = 0, i, *rshp;
+    int dims[FFT_MAXRANK], howmany;
+    fft_plan_entry *e;
+
+    /* X has v logical axes and the real/imaginary axis */
+    if (!fft_args(x, 1, &a, &n, &rank) || !isint(n) || intval(n) < 1 ||
+        (va = valence(a)) < 2 || shpptr(a, va)[va-1] != 2 ||
+        shpptr(a, va)[va-2] != intval(n)/2 + 1) {
+        apush(makefault("?args"));
+        freeup(x);
+        return;
+    }
+
+    v = va - 1;
+    rshp = (nialint *)malloc(v*sizeof(nialint));
+    if (rshp == NULL) {
+        apush(makefault("?memory"));
+        freeup(x);
+        return;
+    }
+    for (i = 0; i < v; i++)
+        rshp[i] = shpptr(a, va)[i];
+    rshp[v-1] = intval(n);
+
+    if (!fft_dims(rshp, v, rank, dims, &howmany)) {
+        free(rshp);
+        apush(makefault("?args"));
+        freeup(x);
+        return;
+    }
+
+    e = fft_get_plan(FFT_C2R, 0, (rank == -1 ? v : rank), dims, howmany);
+    if (e == NULL) {
+        free(rshp);
+        apush(makefault("?fft plan"));
+        freeup(x);
+        return;
+    }
+
+    memcpy(e->in, pfirstreal(a), e->insize*sizeof(double));
+    fftw_execute(e->plan);
+
+    res = new_create_array(realtype, v, 0, rshp);
+    free(rshp);
+    memcpy(pfirstreal(res), e->out, e->outsize*sizeof(double));
+
     apush(res);
     freeup(x);
     return;
 }
 
+
+/**
+ * Set the planning effort for new plans
+ *
+ *    _fft_effort N
+ *
+ * 0 estimates (the default), 1 measures and 2 measures patiently.
+ * Higher effort makes the first transform of a size slower and the
+ * later ones faster. Changing the effort empties the plan cache so
+ * that plans made with the old setting are not reused. The previous
+ * setting is returned.
+ */
+void ifft_effort(void) {
+    nialptr x = apop();
+    nialint old;
+    static unsigned efforts[3] = { FFTW_ESTIMATE, FFTW_MEASURE, FFTW_PATIENT };
+
+    if (!isint(x) || intval(x) < 0 || intval(x) > 2) {
+        apush(makefault("?args"));
+        freeup(x);
+        return;
+    }
+
+    old = (fft_flags == FFTW_PATIENT ? 2 : fft_flags == FFTW_MEASURE ? 1 : 0);
+    if (efforts[intval(x)] != fft_flags)
+        fft_free_plans();
+    fft_flags = efforts[intval(x)];
+
+    apush(createint(old));
+    freeup(x);
+    return;
+}
+
+
+/**
+ * Empty the plan cache
+ *
+ *    _fft_clear Null
+ *
+ * Returns the number of plans released.
+ */
+void ifft_clear(void) {
+    nialptr x = apop();
+
+    apush(createint(fft_free_plans()));
+    freeup(x);
+    return;
+}
+
+
+/**
+ * Save or load the accumulated FFTW wisdom
+ *
+ *    _fft_savewisdom Filename
+ *    _fft_loadwisdom Filename
+ *
+ * Loaded wisdom lets measured plans be created without measuring
+ * again. Both return true on success.
+ */
+void ifft_savewisdom(void) {
+    nialptr x = apop();
+
+    if (kind(x) != chartype && kind(x) != phrasetype) {
+        apush(makefault("?args"));
+        freeup(x);
+        return;
+    }
+
+    apush(fftw_export_wisdom_to_filename(pfirstchar(x)) ? True_val : False_val);
+    freeup(x);
+    return;
+}
+
+
+void ifft_loadwisdom(void) {
+    nialptr x = apop();
+
+    if (kind(x) != chartype && kind(x) != phrasetype) {
+        apush(makefault("?args"));
+        freeup(x);
+        return;
+    }
+
+    apush(fftw_import_wisdom_from_filename(pfirstchar(x)) ? True_val : False_val);
+    freeup(x);
+    return;
+}
+
 #endif /* NIAL_FFTW */
@@ -5,7 +5,7 @@
   
  * --------
  *
- * Simple user level Nial hash table mechanism keyed on phrases.
+ * User level Nial hash table mechanism keyed on arbitrary arrays.
  *
  * Hash tables are Nial data structures consisting of an array
  * of 5 values.
@@ -17,11 +17,25 @@
  * - The second and third are arrays of keys and values of the same size.
  * - The fourth entry is an integer array containing the current no of
  *   entries, the no of probes for the last insert, and the number of
- *   deletions.
+ *   deletions, followed by the cached hash of the key in each slot
+ *   (-1 for an unused slot).
  * - The final entry is a slot for metadata
  *
  * The size of the array of keys and values is a power of two.
  *
+ * Keys are compared with equal and hashed with the structural hash
+ * arrayhash, so any array can be used as a key. The table uses open
+ * addressing with linear probing and Robin Hood displacement: an
+ * entry being inserted takes the slot of any resident entry that is
+ * closer to its home slot. This keeps probe sequences short, lets a
+ * lookup stop as soon as it passes an entry nearer home than itself,
+ * and allows deletion by shifting the following entries back instead
+ * of leaving markers.
+ *
+ * Tables created by earlier versions, which only held the three
+ * counters in the control array, are rebuilt in the new layout the
+ * first time they are used.
+ *
  */
 
 #include "switches.h"
@@ -54,6 +68,7 @@
 #include "lib_main.h"
 #include "absmach.h"
 #include "ops.h"
+#include "compare.h"
 #include "fileio.h"
 
 #include <string.h>
@@ -70,36 +85,27 @@
 /* Percentage full to expand table */
 #define IHT_DEF_EXPAND 70
 
+/* cached hash value for an unused slot */
+#define IHT_EMPTY (-1)
+
+/* C pointer to the cached hashes that follow the counters */
+#define iht_hashes(ctrl) (pfirstint(ctrl) + IHT_CTRL_SIZE)
+
+/* distance of the entry in slot p with hash h from its home slot */
+#define iht_dist(h, p, mask) (((p) - ((h) & (mask))) & (mask))
+
 
 /* Use a random phrase as the indicator of a hash table */
 #define IHT_FLAG "ITH6234046554383511"
 static nialptr iht_key;
 
-/* Our null pointer value, this is zero which is not a phrase */
+/* Marker used for deleted keys in the old table layout */
 static nialptr iht_null;
 
 /* macro to check for a hash table */
 #define ishtable(x) (kind(x) == atype && tally(x) == IHT_TBL_SIZE && fetch_array(x,0) == iht_get_flag_phrase())
 
 
-static inline int hk_eq(nialptr k1, nialptr k2) {
-  if (kind(k1) == kind(k2)) {
-    switch(kind(k1)) {
-    case inttype:
-      return (k1 == k2);
-    case chartype:
-      return (strcmp(pfirstchar(k1), pfirstchar(k2)) == 0);
-    case phrasetype:
-      return (k1 == k2);
-    default:
-      return 0;
-    }
-  } else {
-    return 0;
-  }
-}
-
-
 /**
  * Create a randomised phrase as the identifier of
  * hash tables.
@@ -135,6 +141,27 @@ static nialptr make_htable_part(nialint htsize)
 }
 
 
+/**
+ * Create the control array for a table with htsize slots,
+ * with zero counters and all slots unused.
+ */
+static nialptr make_htable_ctrl(nialint htsize)
+{
+  nialint i;
+  nialint ctrl_size = IHT_CTRL_SIZE + htsize;
+  nialptr res = new_create_array(inttype, 1, 0, &ctrl_size);
+  nialint *ctrl_ptr = pfirstint(res);
+
+  ctrl_ptr[IHT_NCOUNT] = 0;
+  ctrl_ptr[IHT_NPROBES] = 0;
+  ctrl_ptr[IHT_NDELETE] = 0;
+  for (i = 0; i < htsize; i++)
+    ctrl_ptr[IHT_CTRL_SIZE + i] = IHT_EMPTY;
+
+  return res;
+}
+
+
 /**
  * iht_create:
  *
@@ -145,12 +172,7 @@ void iht_create(void)
 {
   nialptr x = apop();
   nialptr res;
-  nialptr ht_keys;
-  nialptr ht_vals;
-  nialptr ht_ctrl;
-  nialint ctrl_size = IHT_CTRL_SIZE;
   nialint ihtbl_size = IHT_DEF_SIZE;
-  nialint *ctrl_ptr;
 
   if (isint(x)) {
     nialint xval = intval(x);
@@ -162,23 +184,11 @@ void iht_create(void)
     while(ihtbl_size < xval)
       ihtbl_size *= 2;
 
-    /* create the key and value arrays */
-    ht_keys = make_htable_part(ihtbl_size);
-    ht_vals = make_htable_part(ihtbl_size);
-
-    /* Create the control array */
-    ht_ctrl = new_create_array(inttype, 1, 0, &ctrl_size);
-    ctrl_ptr = pfirstint(ht_ctrl);
-    ctrl_ptr[IHT_NCOUNT] = 0;
-    ctrl_ptr[IHT_NPROBES] = 0;
-    ctrl_ptr[IHT_NDELETE] = 0;
-
     /* build the basic table */
-    store_array(res, 0, iht_get_flag_phrase());
-    store_array(res, 1, ht_keys);
-    store_array(res, 2, ht_vals);
-    store_array(res, 3, ht_ctrl);
-    store_array(res, 4, Null);
+    replace_array(res, 0, iht_get_flag_phrase());
+    replace_array(res, 1, make_htable_part(ihtbl_size));
+    replace_array(res, 2, make_htable_part(ihtbl_size));
+    replace_array(res, 3, make_htable_ctrl(ihtbl_size));
 
     /* push result */
     apush(res);
@@ -193,285 +203,225 @@ void iht_create(void)
 
 
 /**
- * The universal hash function for strings/phrases
- * from Sedgewick's book 'Algorithms in C'
+ * iht_place: base code for hashing, places a key that is known not
+ *            to be in the table into a table that has room for it.
+ *            The hash of the key is h. Entries nearer their home slot
+ *            are displaced along the chain. No heap allocation is done
+ *            so the C pointers into the arrays remain valid.
+ *            Returns the number of probes used.
  */
+static nialint iht_place(nialptr keya, nialptr vala, nialptr ctrla, nialptr hkey, nialptr hval, nialint h) {
+  nialptr *keys = pfirstitem(keya);
+  nialptr *vals = pfirstitem(vala);
+  nialint *hashes = iht_hashes(ctrla);
+  nialint mask = tally(keya) - 1;
+  nialint pos = h & mask;
+  nialint dist = 0;
+  nialint nprobes = 0;
 
-static      nialint
-hash(char *s, nialint tsz)
-{
-  nialint h = 0, a = 31415, b = 27183;
+  /* the entry in hand holds a reference to its key and value */
+  incrrefcnt(hkey);
+  incrrefcnt(hval);
 
-  for(; *s != '\000'; s++, a = a*b % (tsz-1))
-    h = (a*h + *s)%tsz;
+  for(;;) {
+    nialint sh = hashes[pos];
 
-  return h;
-}
+    nprobes++;
 
+    if (sh == IHT_EMPTY) {
+      /* unused slot, release the Null fillers and store the entry */
+      nialptr oldk = keys[pos], oldv = vals[pos];
+
+      keys[pos] = hkey;
+      vals[pos] = hval;
+      hashes[pos] = h;
+      decrrefcnt(oldk);
+      freeup(oldk);
+      decrrefcnt(oldv);
+      freeup(oldv);
+      return nprobes;
+    }
 
-/**
- * ht_hash computes two hash keys, one for primary lookup and
- * one for probes. The probe value attempts to use more of the
- * hash key to avoid overlapping chains when two phrases hash
- * to the same value.
- */
-static void ht_hash(nialptr hkey, nialint tbsize, nialint *nhash1, nialint *nhash2) {
-  static int primes[8] = {
-    9923, 9929, 9931, 9941, 9949, 9967, 9973, 10007
-  };
-  nialint hval;
-
-  switch(kind(hkey)) {
-  case phrasetype: 
-  case chartype:
-    hval = hash(pfirstchar(hkey), tbsize);
-    break;
-
-  case inttype:
-    hval = intval(hkey);
-    break;
-
-  default:
-    hval = 0;
-  }
+    if (iht_dist(sh, pos, mask) < dist) {
+      /* the resident entry is nearer home, take its slot */
+      nialptr tk = keys[pos], tv = vals[pos];
+
+      keys[pos] = hkey;
+      vals[pos] = hval;
+      hashes[pos] = h;
+      hkey = tk;
+      hval = tv;
+      h = sh;
+      dist = iht_dist(sh, pos, mask);
+    }
 
-  *nhash1 = hval%tbsize;
-  *nhash2 = primes[((hval%tbsize)+(hval/tbsize))&07];
+    pos = (pos + 1) & mask;
+    dist++;
+  }
 }
 
 
-
 /**
- * iht_insert1: base code for hashing, insert a single key/value pair.
- *              If there is no space the fnction returns -1, otherwise
- *              the number of probes required to insert the value. The
- *              supplied table arrays are used to simplify
- *              later functions.
- *
- * The itype (insertion type) is used to distinguish between the 
- * different ways that the value is inserted. 
- *          0 - pure new insertion
- *          1 - insertion into an emptied slot
- *          2 - replacement of existing value
+ * iht_find: look up a key, returning its slot or -1 if it is absent.
+ *           The key is item j of src, or src itself when j is -1, so the
+ *           items of a homogeneous list can be looked up without
+ *           creating them. The hash of the key is h.
  */
-static nialint iht_insert1(nialptr keya, nialptr vala, nialptr hkey, nialptr hval, nialint *itype) {
-  nialint tkeya = tally(keya);
-  nialint hbase, hlook, hprobe;
-  nialint nprobes = 0;
+static nialint iht_find(nialptr keya, nialptr ctrla, nialptr src, nialint j, nialint h) {
+  nialint *hashes = iht_hashes(ctrla);
+  nialint mask = tally(keya) - 1;
+  nialint pos = h & mask;
+  nialint dist = 0;
 
-  /* assume a new insert */
-  *itype = 0;
-
-  /* Get the two hash keys */
-  ht_hash(hkey, tkeya, &hbase, &hprobe);
-
-  hlook = hbase;
   for(;;) {
-    nialptr klook = fetch_array(keya, hlook);
-
-    nprobes++;
+    nialint sh = hashes[pos];
 
-    if (hk_eq(klook,hkey)) {
-      /* Found an existing entry, this is a replacement */
-      replace_array(vala, hlook, hval);
-      *itype = 2;
-      return nprobes;
-    } else if (klook == Null) {
-      /* empty slot, no further chain */
-      replace_array(keya, hlook, hkey);
-      replace_array(vala, hlook, hval);
+    if (sh == IHT_EMPTY || iht_dist(sh, pos, mask) < dist)
+      return -1;
 
-      return nprobes;
-    } else if (klook == iht_null) {
-      /* 
-       * deleted slot, can re-use only if same key as original. 
-       * Otherwise we may end up with duplicated keys
-       */
-      nialptr vlook = fetch_array(vala, hlook);
-      if (hk_eq(vlook,hkey)) {
-        replace_array(keya, hlook, hkey);
-        replace_array(vala, hlook, hval);
-        *itype = 1;
-
-        return nprobes;
-      }
+    if (sh == h) {
+      int found = (j < 0 ? equalitem(keya, pos, src)
+                         : equalitem(src, j, fetch_array(keya, pos)));
+      if (found)
+        return pos;
     }
-    
-    /* If we get here then look for another slot */
-    hlook = (hlook + hprobe) % tkeya;
 
-    /* check if we have looped around, i.e. table full */
-    if (hlook == hbase)
-      return -1;
+    pos = (pos + 1) & mask;
+    dist++;
   }
-
-  return -1; /* should not be reached */
 }
 
 
 /**
- * iht_delete1: support routine to delete an entry by key
+ * iht_delete1: support routine to delete the entry in slot pos.
+ *              The entries following it in the chain are shifted
+ *              back one slot so no deletion marker is needed.
  */
-static nialint iht_delete1(nialptr keya, nialptr vala, nialptr hkey) {
-  nialint tkeya = tally(keya);
-  nialint hbase, hlook, hprobe;
-
-  /* Get the two hash keys */
-  ht_hash(hkey, tkeya, &hbase, &hprobe);
-
-  hlook = hbase;
-  for(;;) {
-    nialptr klook = fetch_array(keya, hlook);
-
-    if (hk_eq(klook,hkey)) {
-      /* 
-       * Found an existing entry. To delete the entry we clear out the 
-       * key array slot. And set the value array slot to hodl the key.
-       * This will allow us to re-use the slot for the original key
-       * while avoiding a duplicated key.
-       */
-      replace_array(keya, hlook, iht_null);
-      replace_array(vala, hlook, keya);
-      return 1;
-    } else if (klook == Null) {
-      return 0;
-    } else {
-      /* look for another slot */
-      hlook = (hlook + hprobe) % tkeya;
-
-      /* check if we have looped around, i.e. table full */
-      if (hlook == hbase)
-        return 0;
-    }
+static void iht_delete1(nialptr keya, nialptr vala, nialptr ctrla, nialint pos) {
+  nialptr *keys = pfirstitem(keya);
+  nialptr *vals = pfirstitem(vala);
+  nialint *hashes = iht_hashes(ctrla);
+  nialint mask = tally(keya) - 1;
+  nialptr oldk = keys[pos], oldv = vals[pos];
+  nialint next = (pos + 1) & mask;
+
+  while (hashes[next] != IHT_EMPTY && iht_dist(hashes[next], next, mask) > 0) {
+    keys[pos] = keys[next];
+    vals[pos] = vals[next];
+    hashes[pos] = hashes[next];
+    pos = next;
+    next = (next + 1) & mask;
   }
 
-  return -1; /* should not be reached */
+  keys[pos] = Null;
+  vals[pos] = Null;
+  hashes[pos] = IHT_EMPTY;
+  incrrefcnt(Null);
+  incrrefcnt(Null);
+
+  decrrefcnt(oldk);
+  freeup(oldk);
+  decrrefcnt(oldv);
+  freeup(oldv);
 }
 
 
 /**
- * iht_getkeys: gets the list of keys in a hash table.
- * the Nial level routine sorts it.
+ * iht_resize: rebuild the table with htsize slots. The old key and
+ *             value arrays are given separately so that tables in
+ *             the old layout can be converted; in that layout a slot
+ *             is unused if its key is Null or the deletion marker.
  */
+static void iht_resize(nialptr tbl, nialint htsize, int oldlayout) {
+  nialptr keya = fetch_array(tbl, 1);
+  nialptr vala = fetch_array(tbl, 2);
+  nialptr ctrla = fetch_array(tbl, 3);
+  nialptr nkeya = make_htable_part(htsize);
+  nialptr nvala = make_htable_part(htsize);
+  nialptr nctrla = make_htable_ctrl(htsize);
+  nialint tkeya = tally(keya);
+  nialint cnt = 0;
+  nialint i;
 
-void iht_getkeys(void)
-{ nialptr tbl = apop();
-
-
-  /* The tbl arg must be a valid hashtable */
-  if (!ishtable(tbl)) {
-    apush(makefault("?tgetkeys needs a valid hashtable"));
+  for (i = 0; i < tkeya; i++) {
+    nialptr hkey = fetch_array(keya, i);
+    int used = (oldlayout ? (hkey != Null && hkey != iht_null)
+                          : iht_hashes(ctrla)[i] != IHT_EMPTY);
 
-  }
-  else {
-    nialptr keya, res;
-    nialint i, j, tkeya;
-    nialptr ctrl = fetch_array(tbl,3);
-    nialint *ctrl_ptr = pfirstint(ctrl);
-    nialint cnt = ctrl_ptr[IHT_NCOUNT];
+    if (used) {
+      nialint h = (oldlayout ? arrayhash(hkey) : iht_hashes(ctrla)[i]);
 
-    keya = fetch_array(tbl, 1);
-    tkeya = tally(keya);
-    res = new_create_array(atype,1,cnt,&cnt);
-    j = 0;
-    for (i = 0; i < tkeya; i++) {
-      nialptr hkey = fetch_array(keya, i);
-      if (hkey != Null && hkey != iht_null) {
-	store_array(res,j,hkey);
-	j++;
-      }
+      iht_place(nkeya, nvala, nctrla, hkey, fetch_array(vala, i), h);
+      cnt++;
     }
-    apush(res);
   }
-  freeup(tbl);
-  return;
+
+  store_int(nctrla, IHT_NCOUNT, cnt);
+  store_int(nctrla, IHT_NPROBES, fetch_int(ctrla, IHT_NPROBES));
+
+  /* put new arrays into the table */
+  replace_array(tbl, 1, nkeya);
+  replace_array(tbl, 2, nvala);
+  replace_array(tbl, 3, nctrla);
 }
 
 
 /**
- * iht_rehash: add an array of key/value pairs. this function is
- * only called during a table expansion and all values will fit.
+ * iht_prepare: bring a table to the current layout and make sure
+ *              it has room for n more entries without exceeding
+ *              the expansion threshold.
  */
-static void iht_rehash(nialptr nkeya, nialptr nvala, nialptr keya, nialptr vala) {
-  nialint i;
+static void iht_prepare(nialptr tbl, nialint n) {
+  nialptr keya = fetch_array(tbl, 1);
+  nialptr ctrla = fetch_array(tbl, 3);
   nialint tkeya = tally(keya);
-  nialint itype = 0;
+  nialint need;
+  nialint htsize = tkeya;
 
-  for (i = 0; i < tkeya; i++) {
-    nialptr hkey = fetch_array(keya, i);
-    if (hkey != Null && hkey != iht_null) {
-      nialptr hval = fetch_array(vala, i);
-      iht_insert1(nkeya, nvala, hkey, hval, &itype);
-    }
+  if (tally(ctrla) != IHT_CTRL_SIZE + tkeya) {
+    iht_resize(tbl, tkeya, true);
+    ctrla = fetch_array(tbl, 3);
   }
+
+  need = fetch_int(ctrla, IHT_NCOUNT) + n;
+  while ((100 * need) / IHT_DEF_EXPAND >= htsize)
+    htsize *= 2;
+
+  if (htsize != tkeya)
+    iht_resize(tbl, htsize, false);
 }
 
 
 /**
- * iht_insert_value: static routine to implement the actual insertion
- *
- * All arguments are valid at this point. The function will increase
- * the size of the table to guarantee an insertion.
+ * iht_insert_value: insert or replace the value for the key that is
+ *                   item j of src (src itself if j is -1). The table
+ *                   must already have room for a new entry.
  *
  * The return value is the number of probes required.
- *
  */
-static nialint iht_insert_value(nialptr tbl, nialptr hkey, nialptr hval) {
+static nialint iht_insert_value(nialptr tbl, nialptr src, nialint j, nialptr hval) {
   nialptr keya = fetch_array(tbl, 1);
-  nialint tkeya = tally(keya);
   nialptr vala = fetch_array(tbl, 2);
   nialptr ctrla = fetch_array(tbl, 3);
-  nialint *ctrl_ptr = pfirstint(ctrla);
-  nialint itype = 0;
-  nialint nprobes = 0;
-
-  /* Check if we should expand and/or rehash the table */
-  if (((100*(ctrl_ptr[IHT_NCOUNT]+ctrl_ptr[IHT_NDELETE]+1))/IHT_DEF_EXPAND) > tkeya) {
-    nialptr nkeya;
-    nialptr nvala;
-
-    if (((100*(ctrl_ptr[IHT_NCOUNT]+1))/IHT_DEF_EXPAND) > tkeya) {
-      /* Expand the table */
-      nkeya = make_htable_part(2*tkeya);
-      nvala = make_htable_part(2*tkeya);
-    } else {
-      /* keep the same size */
-      nkeya = make_htable_part(tkeya);
-      nvala = make_htable_part(tkeya);
-    }
-
-    /* Add the existing elements to the new arrays */
-    iht_rehash(nkeya, nvala, keya, vala);
-
-    /* add the new entry, this will now succeed */
-    nprobes = iht_insert1(nkeya, nvala, hkey, hval, &itype);
-    ctrl_ptr = pfirstint(ctrla);
-    /* Check that this is not just a replacement */
-    if (itype != 2)
-      ctrl_ptr[IHT_NCOUNT]++;            /* one more entry */
-    ctrl_ptr[IHT_NPROBES] = nprobes;   /* probe count    */
-    ctrl_ptr[IHT_NDELETE] = 0;         /* rehash cleared this */
-
-    /* put new arrays into the table */
-    replace_array(tbl, 1, nkeya);
-    replace_array(tbl, 2, nvala);
-
-    return nprobes;
+  nialint h = (j < 0 ? arrayhash(src) : itemhash(src, j));
+  nialint pos = iht_find(keya, ctrla, src, j, h);
+  nialint nprobes;
+
+  if (pos >= 0) {
+    /* Found an existing entry, this is a replacement */
+    replace_array(vala, pos, hval);
+    nprobes = iht_dist(h, pos, tally(keya) - 1) + 1;
   } else {
-    /* directly insert entry */
-    nprobes = iht_insert1(keya, vala, hkey, hval, &itype);
-    ctrl_ptr = pfirstint(ctrla);
-    /* If just a replacement the count does not increase */
-    if (itype != 2)
-      ctrl_ptr[IHT_NCOUNT]++;
-    ctrl_ptr[IHT_NPROBES] = nprobes;
-
-    /* Did the insert replace a deleted entry */
-    if (itype == 1)
-      ctrl_ptr[IHT_NDELETE]--;
-
-    return nprobes;
+    nialptr hkey = (j < 0 ? src : fetchasarray(src, j));
+
+    apush(hkey);
+    nprobes = iht_place(keya, vala, ctrla, hkey, hval, h);
+    freeup(apop());
+    store_int(ctrla, IHT_NCOUNT, fetch_int(ctrla, IHT_NCOUNT) + 1);
   }
+
+  store_int(ctrla, IHT_NPROBES, nprobes);
+  return nprobes;
 }
 
 
@@ -481,38 +431,64 @@ static nialint iht_insert_value(nialptr tbl, nialptr hkey, nialptr hval) {
 static int iht_get_value(nialptr tbl, nialptr hkey, nialptr *hval)
 {
   nialptr keya = fetch_array(tbl, 1);
-  nialptr vala = fetch_array(tbl, 2);
-  nialint tkeya = tally(keya);
-  nialint hbase, hlook, hprobe;
-  int not_finished = 0;
-
-  /* Get the two hash keys */
-  ht_hash(hkey, tkeya, &hbase, &hprobe);
-
-  hlook = hbase;
-  while(not_finished == 0) {
-    nialptr klook = fetch_array(keya, hlook);
-
-    if (hk_eq(klook,hkey)) {
-      /* Found the entry */
-      *hval = fetch_array(vala, hlook);
-      return 0;
-    } else if (klook == Null) {
-      /* empty slot, no further chain */
-      return 1;
-    } else {
-      /* look for another slot */
-      hlook = (hlook + hprobe) % tkeya;
-      if (hlook == hbase) {
-	    /* looped around without finding data */
-	    not_finished = 1;
+  nialptr ctrla = fetch_array(tbl, 3);
+  nialint pos;
+
+  if (tally(ctrla) != IHT_CTRL_SIZE + tally(keya)) {
+    iht_prepare(tbl, 0);
+    keya = fetch_array(tbl, 1);
+    ctrla = fetch_array(tbl, 3);
+  }
+
+  pos = iht_find(keya, ctrla, hkey, -1, arrayhash(hkey));
+  if (pos < 0)
+    return 1;
+
+  *hval = fetch_array(fetch_array(tbl, 2), pos);
+  return 0;
+}
+
+
+/**
+ * iht_getkeys: gets the list of keys in a hash table.
+ * the Nial level routine sorts it.
+ */
+
+void iht_getkeys(void)
+{ nialptr tbl = apop();
+
+
+  /* The tbl arg must be a valid hashtable */
+  if (!ishtable(tbl)) {
+    apush(makefault("?tgetkeys needs a valid hashtable"));
+
+  }
+  else {
+    nialptr keya, ctrla, res;
+    nialint i, j, tkeya, cnt;
+
+    iht_prepare(tbl, 0);
+    keya = fetch_array(tbl, 1);
+    ctrla = fetch_array(tbl, 3);
+    tkeya = tally(keya);
+    cnt = fetch_int(ctrla, IHT_NCOUNT);
+    res = new_create_array(atype,1,cnt,&cnt);
+    j = 0;
+    for (i = 0; i < tkeya; i++) {
+      if (iht_hashes(ctrla)[i] != IHT_EMPTY) {
+	store_array(res,j,fetch_array(keya, i));
+	j++;
       }
     }
+    if (homotest(res))
+      res = implode(res);
+    apush(res);
   }
-
-  return 1;
+  freeup(tbl);
+  return;
 }
 
+
 /**
  * iht_set:
  *
@@ -521,7 +497,7 @@ static int iht_get_value(nialptr tbl, nialptr hkey, nialptr *hval)
  *          tbl htset [key, val]
  *   or     htset [tbl, [key, val]]
  *
- * key must be a phrase.
+ * key can be any array.
  */
 void iht_set()
 {
@@ -544,19 +520,13 @@ void iht_set()
       nialptr hkey, hval;
       splitfb(hdata, &hkey, &hval);
 
-      /* key must be a phrase */
-      if (kind(hkey) == phrasetype || kind(hkey) == chartype || kind(hkey) == inttype) {
-	/* -- do the insert -- */
-	iht_insert_value(tbl, hkey, hval);
-	apush(hval);
-	freeup(args);
-	return;
-      } else {
-	apush(makefault("?tset invalid key"));
-	freeup(args);
-	return;
-      }
-
+      /* -- do the insert -- */
+      iht_prepare(tbl, 1);
+      iht_insert_value(tbl, hkey, -1, hval);
+      apush(hval);
+      freeup(hkey);
+      freeup(args);
+      return;
     } else {
       apush(makefault("?tset needs a key/value pair"));
       freeup(args);
@@ -573,7 +543,11 @@ void iht_set()
 /**
  * ht_get - retrieve a value from a hashtable
  *
- *    tbl ht_get phrase
+ *    tbl ht_get key
+ *    tbl ht_get [key, default]
+ *
+ * A key that is a pair must be given with a default since
+ * a pair is taken to be a key and a default.
  */
 void iht_get()
 {
@@ -590,36 +564,31 @@ void iht_get()
   /* Split arguments into table and key */
   splitfb(args, &tbl, &hright);
 
-  if(tally(hright) == 1 || kind(hright) == chartype) {
-    hkey = hright;
-    hdef = invalidptr;
-  } else if (tally(hright) == 2) {
+  if (tally(hright) == 2 && kind(hright) != chartype) {
     splitfb(hright, &hkey, &hdef);
   } else {
-    apush(makefault("?tget second arg not a pair"));
-    freeup(args);
-    return;
+    hkey = hright;
+    hdef = invalidptr;
   }
 
   /* The tbl arg must be a valid hashtable */
   if (ishtable(tbl)) {
-    /* key must be a phrase */
-    if (kind(hkey) == phrasetype || kind(hkey) == chartype || kind(hkey) == inttype) {
-      nialptr hval;
-      if (iht_get_value(tbl, hkey, &hval) == 0) {
-	/* found an entry */
-	apush(hval);
+    nialptr hval;
+
+    apush(hkey);
+    if (iht_get_value(tbl, hkey, &hval) == 0) {
+      /* found an entry */
+      apush(hval);
+    } else {
+      /* No entry found */
+      if(hdef == invalidptr) {
+        apush(makefault("?tget found no entry"));
       } else {
-	/* No entry found */
-	if(hdef == invalidptr) {
-	  apush(makefault("?tget found no entry"));
-	} else {
-	  apush(hdef);
-	}
+        apush(hdef);
       }
-    } else {
-      apush(makefault("?tget invalid key"));
     }
+    swap();
+    freeup(apop());
   } else {
     apush(makefault("?tget invalid table"));
   }
@@ -629,6 +598,130 @@ void iht_get()
 }
 
 
+/**
+ * iht_getmany - retrieve the values for an array of keys in one call
+ *
+ *    _tgetmany tbl keys
+ *    _tgetmany tbl keys default
+ *
+ * The result has the shape of keys. Keys that are not in the table
+ * give the default, or a fault if no default is given. The items of
+ * a homogeneous keys array are looked up without being created.
+ */
+void iht_getmany()
+{
+  nialptr args = apop();
+  nialptr tbl, keys, hdef, res, nf;
+  nialint i, t;
+  int v;
+
+  if (kind(args) != atype || (tally(args) != 2 && tally(args) != 3)) {
+    apush(makefault("?tgetmany expects a table, keys and an optional default"));
+    freeup(args);
+    return;
+  }
+
+  tbl = fetch_array(args, 0);
+  keys = fetch_array(args, 1);
+  hdef = (tally(args) == 3 ? fetch_array(args, 2) : invalidptr);
+
+  if (!ishtable(tbl)) {
+    apush(makefault("?tgetmany invalid table"));
+    freeup(args);
+    return;
+  }
+
+  iht_prepare(tbl, 0);
+
+  t = tally(keys);
+  v = valence(keys);
+  res = new_create_array(atype, v, 0, shpptr(keys, v));
+  apush(res);
+  nf = invalidptr;
+  for (i = 0; i < t; i++) {
+    nialptr keya = fetch_array(tbl, 1);
+    nialptr ctrla = fetch_array(tbl, 3);
+    nialint pos = (atomic(keys) ? iht_find(keya, ctrla, keys, -1, arrayhash(keys))
+                                : iht_find(keya, ctrla, keys, i, itemhash(keys, i)));
+
+    if (pos >= 0) {
+      store_array(res, i, fetch_array(fetch_array(tbl, 2), pos));
+    }
+    else {
+      /* the fault is made on the first miss so that it only
+         triggers when a key is actually missing */
+      if (nf == invalidptr)
+        nf = (hdef == invalidptr ? makefault("?tget found no entry") : hdef);
+      store_array(res, i, nf);
+    }
+  }
+
+  apop();
+  if (homotest(res))
+    res = implode(res);
+
+  apush(res);
+  freeup(args);
+  return;
+}
+
+
+/**
+ * iht_setmany - add or replace the entries for arrays of keys and values
+ *
+ *    _tsetmany tbl keys values
+ *
+ * keys and values must have the same tally. The table is expanded at
+ * most once for the whole batch. The result is values.
+ */
+void iht_setmany()
+{
+  nialptr args = apop();
+  nialptr tbl, keys, vals;
+  nialint i, t;
+
+  if (kind(args) != atype || tally(args) != 3) {
+    apush(makefault("?tsetmany expects a table, keys and values"));
+    freeup(args);
+    return;
+  }
+
+  tbl = fetch_array(args, 0);
+  keys = fetch_array(args, 1);
+  vals = fetch_array(args, 2);
+
+  if (!ishtable(tbl)) {
+    apush(makefault("?tsetmany invalid table"));
+    freeup(args);
+    return;
+  }
+
+  t = tally(keys);
+  if (t != tally(vals)) {
+    apush(makefault("?tsetmany keys and values differ in tally"));
+    freeup(args);
+    return;
+  }
+
+  iht_prepare(tbl, t);
+
+  for (i = 0; i < t; i++) {
+    nialptr hval = fetchasarray(vals, i);
+
+    apush(hval);
+    if (atomic(keys))
+      iht_insert_value(tbl, keys, -1, hval);
+    else
+      iht_insert_value(tbl, keys, i, hval);
+    freeup(apop());
+  }
+
+  apush(vals);
+  freeup(args);
+  return;
+}
+
+
 void iis_ht_table(void) {
   nialptr x = apop();
 
@@ -686,20 +779,24 @@ void iht_delete()
   if(tally(args) == 2) {
     splitfb(args, &tbl, &key);
 
-    if (ishtable(tbl) && (kind(key) == phrasetype || kind(key) == chartype || kind(key) == inttype))  {
-      nialptr keya = fetch_array(tbl, 1);
-      nialptr vala = fetch_array(tbl, 2);
-      nialint res = iht_delete1(keya, vala, key);
+    if (ishtable(tbl))  {
+      nialptr keya, ctrla;
+      nialint pos;
+
+      apush(key);
+      iht_prepare(tbl, 0);
+      keya = fetch_array(tbl, 1);
+      ctrla = fetch_array(tbl, 3);
+      pos = iht_find(keya, ctrla, key, -1, arrayhash(key));
 
       /* decrement the count of entries in the table */
-      if (res == 1) {
-	nialptr ctrla = fetch_array(tbl, 3);
-	nialint *ctrl_ptr = pfirstint(ctrla);
-	ctrl_ptr[IHT_NCOUNT]--;
-	ctrl_ptr[IHT_NDELETE]++;
+      if (pos >= 0) {
+        iht_delete1(keya, fetch_array(tbl, 2), ctrla, pos);
+        store_int(ctrla, IHT_NCOUNT, fetch_int(ctrla, IHT_NCOUNT) - 1);
       }
 
-      apush(createint(res));
+      freeup(apop());
+      apush(createint(pos >= 0 ? 1 : 0));
     } else {
       apush(makefault("?tdel_args"));
     }
@@ -59,27 +59,59 @@ included in defs.ndf if REGEXP is defined.
 
 
 /**
- *  Hold precompiled regular expressions.
- *  These are indexed by an integer in the range 0..16
+ * Compiled regular expressions are kept in a cache keyed by the
+ * pattern text and the compile options. An entry is compiled the first
+ * time it is used and is kept until re_clear is called, so recompiling
+ * a pattern that is already known costs a hash lookup.
+ *
+ * Each entry also records the literal text that every match must
+ * contain, when the pattern starts with one. Strings that do not
+ * contain it are rejected with a substring search without calling
+ * regexec, and a pattern that is entirely literal is matched by the
+ * search alone.
  */
-static regex_t *re_compiled[16] = { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-				   NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL };
- 
+typedef struct re_entry {
+  char       *pattern;      /* pattern text */
+  int         cflags;       /* Posix compile flags */
+  regex_t     re;           /* compiled expression */
+  char       *literal;      /* text every match contains, or NULL */
+  size_t      litlen;
+  int         litonly;      /* the pattern is exactly the literal */
+  unsigned long hash;
+  struct re_entry *next;    /* next entry in the bucket */
+} re_entry;
+
+static re_entry **re_buckets = NULL;
+static nialint re_nbuckets = 0;
+static nialint re_nentries = 0;
+
+
+/**
+ *  The numbered slots used by re_compile, re_test and re_match.
+ *  A slot refers to an entry in the cache. The slot table grows to
+ *  hold any non-negative index.
+ */
+static re_entry **re_slots = NULL;
+static nialint re_nslots = 0;
+
 
 /**
- * The Posix flags to match to Nial
+ * The Posix flags to match to Nial. The first four are
+ * compile flags and the last two are match flags.
  */
 #define NUM_OPTS 6
+#define NUM_COPTS 4
 static int posix_flags[NUM_OPTS] = { REG_EXTENDED, REG_ICASE, REG_NOSUB, 
 				     REG_NEWLINE, REG_NOTBOL, REG_NOTEOL};
 
 /**
- * translate Nial options to Posix options 
+ * translate Nial options in the range [first,last) to Posix options.
+ * The compile and match flags share values so they are kept apart.
  */
-static int reg_options(nialint opts) {
-  int i, mask = 1, res = 0;
+static int reg_options(nialint opts, int first, int last) {
+  int i, mask = 1 << first, res = 0;
 
-  for (i = 0; i < NUM_OPTS; i++, mask <<= 1)
+  for (i = first; i < last; i++, mask <<= 1)
     if (mask&opts) {
       res |= posix_flags[i];
     }
@@ -87,6 +119,174 @@ static int reg_options(nialint opts) {
   return res;
 }
 
+#define reg_cflags(opts) reg_options(opts, 0, NUM_COPTS)
+#define reg_eflags(opts) reg_options(opts, NUM_COPTS, NUM_OPTS)
+
+
+static unsigned long re_hash(char *pattern, int cflags)
+{
+  unsigned long h = 5381 + cflags;
+
+  while (*pattern)
+    h = 33*h + (unsigned char)*pattern++;
+  return h;
+}
+
+
+/**
+ * Find the literal text at the start of a pattern that every match
+ * must contain. Patterns with alternation or case folding have none.
+ * A repetition after the literal text applies to its last character,
+ * so that character is dropped.
+ */
+static void re_literal(re_entry *e)
+{
+  char *p = e->pattern;
+  char *meta = (e->cflags & REG_EXTENDED ? ".[\\*^$+?{}()|" : ".[\\*^$");
+  int anchored = 0;
+  size_t n;
+
+  e->literal = NULL;
+  e->litlen = 0;
+  e->litonly = 0;
+
+  if ((e->cflags & REG_ICASE) || strchr(p, '|') != NULL)
+    return;
+
+  if (*p == '^') {
+    anchored = 1;
+    p++;
+  }
+
+  n = strcspn(p, meta);
+  if (p[n] == '\0')
+    e->litonly = !anchored;
+  else if (p[n] == '*' || p[n] == '\\' ||
+           ((e->cflags & REG_EXTENDED) && strchr("+?{", p[n]) != NULL))
+    n = (n > 0 ? n - 1 : 0);
+
+  if (n == 0 || (e->literal = (char *)malloc(n + 1)) == NULL) {
+    e->litonly = 0;
+    return;
+  }
+
+  memcpy(e->literal, p, n);
+  e->literal[n] = '\0';
+  e->litlen = n;
+}
+
+
+/**
+ * Return the cache entry for a pattern, compiling it if it is new.
+ * On failure NULL is returned and *err holds the regcomp error.
+ */
+static re_entry *re_lookup(char *pattern, int cflags, int *err)
+{
+  unsigned long h = re_hash(pattern, cflags);
+  re_entry *e;
+
+  if (re_nbuckets > 0) {
+    for (e = re_buckets[h % re_nbuckets]; e != NULL; e = e->next)
+      if (e->hash == h && e->cflags == cflags && strcmp(e->pattern, pattern) == 0)
+        return e;
+  }
+
+  /* keep the chains short by doubling the bucket table */
+  if (re_nentries >= re_nbuckets) {
+    nialint i, nb = (re_nbuckets == 0 ? 64 : 2 * re_nbuckets);
+    re_entry **nbk = (re_entry **)calloc(nb, sizeof(re_entry *));
+
+    if (nbk == NULL) {
+      *err = REG_ESPACE;
+      return NULL;
+    }
+    for (i = 0; i < re_nbuckets; i++) {
+      while ((e = re_buckets[i]) != NULL) {
+        re_buckets[i] = e->next;
+        e->next = nbk[e->hash % nb];
+        nbk[e->hash % nb] = e;
+      }
+    }
+    free(re_buckets);
+    re_buckets = nbk;
+    re_nbuckets = nb;
+  }
+
+  e = (re_entry *)malloc(sizeof(re_entry));
+  if (e == NULL || (e->pattern = strdup(pattern)) == NULL) {
+    free(e);
+    *err = REG_ESPACE;
+    return NULL;
+  }
+
+  *err = regcomp(&e->re, pattern, cflags);
+  if (*err != 0) {
+    free(e->pattern);
+    free(e);
+    return NULL;
+  }
+
+  e->cflags = cflags;
+  e->hash = h;
+  re_literal(e);
+  e->next = re_buckets[h % re_nbuckets];
+  re_buckets[h % re_nbuckets] = e;
+  re_nentries++;
+  return e;
+}
+
+
+/**
+ * Match a string against a cache entry. The result is 0 for a match,
+ * REG_NOMATCH or a Posix error code. If match is not NULL it is set
+ * to the extent of the whole match.
+ */
+static int re_exec(re_entry *e, char *p, regmatch_t *match, int eflags)
+{
+  if (e->literal != NULL) {
+    char *q = strstr(p, e->literal);
+
+    if (q == NULL)
+      return REG_NOMATCH;
+    if (e->litonly) {
+      if (match != NULL) {
+        match->rm_so = q - p;
+        match->rm_eo = match->rm_so + e->litlen;
+      }
+      return 0;
+    }
+  }
+
+  return regexec(&e->re, p, (match != NULL ? 1 : 0), match, eflags);
+}
+
+
+/* store an entry in a numbered slot, growing the slot table as needed */
+
+static int re_setslot(nialint index, re_entry *e)
+{
+  if (index >= re_nslots) {
+    nialint i, ns = (index < 16 ? 16 : 2 * index);
+    re_entry **nsl = (re_entry **)realloc(re_slots, ns * sizeof(re_entry *));
+
+    if (nsl == NULL)
+      return 0;
+    for (i = re_nslots; i < ns; i++)
+      nsl[i] = NULL;
+    re_slots = nsl;
+    re_nslots = ns;
+  }
+
+  re_slots[index] = e;
+  return 1;
+}
+
+#define re_slot(i) ((i) >= 0 && (i) < re_nslots ? re_slots[i] : NULL)
+
+static char *re_compile_fault(int err)
+{
+  return (err == REG_ESPACE ? "?malloc error" : "?regex compile error");
+}
 
 
 /**
@@ -103,8 +303,8 @@ iregexp_c(void)
   nialptr     re_string;
   nialptr     re_options; 
   nialint     index;
-  int         res;
-  regex_t *re;
+  int         err;
+  re_entry    *e;
 
 
   /* validate the arguments */
@@ -121,37 +321,26 @@ iregexp_c(void)
   re_options = fetch_array(z, 2);
 
   /* validate types */
-  if (!isint(re_index) || !isint(re_options) || kind(re_string) != chartype || tally(re_string) == 0) {
+  if (!isint(re_index) || intval(re_index) < 0 || !isint(re_options) ||
+      kind(re_string) != chartype || tally(re_string) == 0) {
     apush(makefault("?argtypes"));
     freeup(z);
     return;
   }
 
-  /* Clear any previously compiled regex */
-  index = intval(re_index) & 0x0f;
-  if (re_compiled[index] != NULL) {
-    regfree(re_compiled[index]);
-    re_compiled[index] = NULL;
-  }
-    
-  /* allocate a regex_t structure */
-  re = (regex_t*)malloc(sizeof(regex_t));
-  if (re == NULL) {
-    apush(makefault("?malloc error"));
+  /* find or compile the regex */
+  index = intval(re_index);
+  e = re_lookup(pfirstchar(re_string), reg_cflags(intval(re_options)), &err);
+  if (e == NULL) {
+    apush(makefault(re_compile_fault(err)));
     freeup(z);
     return;
   }
 
-  /* compile the regex */
-  res = regcomp(re, pfirstchar(re_string), reg_options(intval(re_options)));
-  if (res == 0)
-    re_compiled[index] = re;
-  else
-  {
-    regfree(re);
-      apush(makefault("?regex compile error"));
-      freeup(z);
-      return;
+  if (!re_setslot(index, e)) {
+    apush(makefault("?malloc error"));
+    freeup(z);
+    return;
   }
 
   /* return the result true for success */
@@ -178,7 +367,7 @@ iregexp_t(void)
   nialptr     re_options; 
   nialint     index;
   int         res;
-  regex_t     *re;
+  re_entry    *e;
   char        *p = "";
 
   /* validate the arguments */
@@ -208,22 +397,20 @@ iregexp_t(void)
   }
 
   /* Check for a compiled regex */
-  index = intval(re_index) & 0x0f;
-  if (re_compiled[index] == NULL) {
+  index = intval(re_index);
+  e = re_slot(index);
+  if (e == NULL) {
     apush(makefault("?regex"));
     freeup(z);
     return;
   }
-    
-  /* get the regex_t structure */
-  re = (regex_t*)re_compiled[index];
 
   /* get the string to be matched, null case already handled */
   if (kind(re_string) == chartype)
     p = pfirstchar(re_string);
 
   /* perform the match */
-  res = regexec(re, p, 0, NULL, reg_options(intval(re_options)));
+  res = re_exec(e, p, NULL, reg_eflags(intval(re_options)));
   if (res == 0) {
     apush(True_val);
   } else if (res == REG_NOMATCH) {
@@ -258,7 +445,7 @@ iregexp_m(void)
   regmatch_t  match[128];
   regmatch_t  *matches = match;
   nialint     nmatch;
-  regex_t     *re;
+  re_entry    *e;
   char        *p = "";   
 
   /* validate the arguments */
@@ -293,15 +480,13 @@ iregexp_m(void)
   }
 
   /* Check for a compiled regex */
-  index = intval(re_index) & 0x0f;
-  if (re_compiled[index] == NULL) {
+  index = intval(re_index);
+  e = re_slot(index);
+  if (e == NULL) {
     apush(makefault("?regex"));
     freeup(z);
     return;
   }
-    
-  /* get the regex_t structure */
-  re = (regex_t*)re_compiled[index];
 
   /* sort out the number of matches */
   nmatch = intval(re_nmatch);
@@ -311,8 +496,11 @@ iregexp_m(void)
     matches[i].rm_eo = -1;
   }
 
-  /* perform the match */
-  res = regexec(re, p, nmatch, match, reg_options(intval(re_options)));
+  /* perform the match, rejecting strings without the literal text first */
+  if (e->literal != NULL && strstr(p, e->literal) == NULL)
+    res = REG_NOMATCH;
+  else
+    res = regexec(&e->re, p, nmatch, match, reg_eflags(intval(re_options)));
   if (res == 0) {
     nialptr ares;
     nialint mcount = 0;
@@ -578,5 +766,404 @@ iregexp_splice(void)
 }
 
 
+/**
+ * The strings for the batch primitives. They are either a list of
+ * strings or a single string that is split at newlines. A trailing
+ * newline does not start another line.
+ */
+typedef struct {
+  nialptr     src;
+  int         split;        /* src is one string split at newlines */
+  nialint     n;            /* number of strings */
+  nialint     *pos;         /* start and length of each line */
+  char        *buf;         /* copy of the current line */
+  char        one[2];       /* a single character item */
+} re_lines;
+
+
+static int re_lines_init(re_lines *l, nialptr x)
+{
+  nialint i, t = tally(x);
+
+  l->src = x;
+  l->pos = NULL;
+  l->buf = NULL;
+  l->n = 0;
+  l->split = (kind(x) == chartype && !atomic(x));
+
+  if (l->split) {
+    char *p = pfirstchar(x), *q, *end = p + t;
+    nialint maxlen = 0, k = 0;
+
+    for (q = p; q < end; q++)
+      if (*q == '\n')
+        l->n++;
+    if (t > 0 && end[-1] != '\n')
+      l->n++;
+
+    l->pos = (nialint *)malloc((2 * l->n + 1) * sizeof(nialint));
+    if (l->pos == NULL)
+      return 0;
+    for (q = p; k < l->n; k++) {
+      char *nl = memchr(q, '\n', end - q);
+      nialint len = (nl == NULL ? end - q : nl - q);
+
+      l->pos[2*k] = q - p;
+      l->pos[2*k+1] = len;
+      if (len > maxlen)
+        maxlen = len;
+      q += len + 1;
+    }
+
+    l->buf = (char *)malloc(maxlen + 1);
+    return (l->buf != NULL);
+  }
+
+  if (kind(x) != atype)
+    return 0;
+
+  for (i = 0; i < t; i++) {
+    nialptr it = fetch_array(x, i);
+
+    if (kind(it) != chartype && tally(it) != 0)
+      return 0;
+  }
+  l->n = t;
+  return 1;
+}
+
+
+/* return the i-th string. heap strings are used in place. */
+
+static char *re_line(re_lines *l, nialint i)
+{
+  nialptr it;
+
+  if (l->split) {
+    memcpy(l->buf, pfirstchar(l->src) + l->pos[2*i], l->pos[2*i+1]);
+    l->buf[l->pos[2*i+1]] = '\0';
+    return l->buf;
+  }
+
+  it = fetch_array(l->src, i);
+  if (tally(it) == 0)
+    return "";
+  if (atomic(it)) {
+    l->one[0] = charval(it);
+    l->one[1] = '\0';
+    return l->one;
+  }
+  return pfirstchar(it);
+}
+
+
+static void re_lines_free(re_lines *l)
+{
+  free(l->pos);
+  free(l->buf);
+}
+
+
+/**
+ * Resolve the pattern argument of a batch primitive to cache entries.
+ * It is a slot number, a pattern string or a list of these. Pattern
+ * strings are compiled with cflags. A slot compiled with REG_NOSUB is
+ * recompiled without it when offsets are wanted.
+ * Returns NULL and sets *msg on failure.
+ */
+static re_entry **re_patterns(nialptr x, int cflags, int offsets,
+                              nialint *npat, int *single, char **msg)
+{
+  re_entry **ents;
+  nialint i, n;
+  int err;
+
+  *single = (isint(x) || (kind(x) == chartype && !atomic(x)));
+  n = (*single ? 1 : tally(x));
+  if (!*single && kind(x) != atype && kind(x) != inttype) {
+    *msg = "?argtypes";
+    return NULL;
+  }
+
+  ents = (re_entry **)malloc((n > 0 ? n : 1) * sizeof(re_entry *));
+  if (ents == NULL) {
+    *msg = "?malloc error";
+    return NULL;
+  }
+
+  for (i = 0; i < n; i++) {
+    nialptr it = invalidptr;
+    nialint index = -1;
+    re_entry *e;
+
+    if (kind(x) == inttype)
+      index = fetch_int(x, (*single ? 0 : i));
+    else {
+      it = (*single ? x : fetch_array(x, i));
+      if (isint(it))
+        index = intval(it);
+    }
+
+    if (it == invalidptr || isint(it)) {
+      e = re_slot(index);
+      if (e == NULL) {
+        *msg = "?regex";
+        break;
+      }
+      if (offsets && (e->cflags & REG_NOSUB)) {
+        e = re_lookup(e->pattern, e->cflags & ~REG_NOSUB, &err);
+        if (e == NULL) {
+          *msg = re_compile_fault(err);
+          break;
+        }
+      }
+    }
+    else if (kind(it) == chartype && !atomic(it) && tally(it) > 0) {
+      e = re_lookup(pfirstchar(it), cflags, &err);
+      if (e == NULL) {
+        *msg = re_compile_fault(err);
+        break;
+      }
+    }
+    else {
+      *msg = "?argtypes";
+      break;
+    }
+    ents[i] = e;
+  }
+
+  if (i < n) {
+    free(ents);
+    return NULL;
+  }
+  *npat = n;
+  return ents;
+}
+
+
+/**
+ * The following code implements the nial primitive to test a list of
+ * strings against one or more regular expressions
+ *
+ *    re_testmany <patterns> <strings> <options>
+ *
+ * patterns is a slot index, a pattern string or a list of these.
+ * strings is a list of strings or a single string which is split at
+ * newlines. The result is a boolean list with an entry for each string,
+ * or a boolean table with a row for each pattern.
+ */
+void
+iregexp_testmany(void)
+{
+  nialptr     z = apop();
+  nialptr     re_pats, re_strings, re_options, res;
+  nialint     npat, i, k, shp[2];
+  int         single, eflags, r = 0;
+  re_entry    **ents;
+  re_lines    lines;
+  char        *msg;
+
+  /* validate the arguments */
+  if (tally(z) != 3 || kind(z) != atype) {
+    apush(makefault("?args"));
+    freeup(z);
+    return;
+  }
+
+  re_pats = fetch_array(z, 0);
+  re_strings = fetch_array(z, 1);
+  re_options = fetch_array(z, 2);
+
+  if (!isint(re_options)) {
+    apush(makefault("?argtypes"));
+    freeup(z);
+    return;
+  }
+
+  ents = re_patterns(re_pats, reg_cflags(intval(re_options)) | REG_NOSUB, 0,
+                     &npat, &single, &msg);
+  if (ents == NULL) {
+    apush(makefault(msg));
+    freeup(z);
+    return;
+  }
+
+  if (!re_lines_init(&lines, re_strings)) {
+    re_lines_free(&lines);
+    free(ents);
+    apush(makefault("?argtypes"));
+    freeup(z);
+    return;
+  }
+  shp[0] = npat;
+  shp[1] = lines.n;
+  /* string pointers are only taken after the result is created */
+  res = (single ? new_create_array(booltype, 1, 0, &shp[1])
+                : new_create_array(booltype, 2, 0, shp));
+
+  eflags = reg_eflags(intval(re_options));
+  for (i = 0; i < lines.n && (r == 0 || r == REG_NOMATCH); i++) {
+    char *p = re_line(&lines, i);
+
+    for (k = 0; k < npat; k++) {
+      r = re_exec(ents[k], p, NULL, eflags);
+      if (r != 0 && r != REG_NOMATCH)
+        break;
+      store_bool(res, k * lines.n + i, r == 0);
+    }
+  }
+
+  re_lines_free(&lines);
+  free(ents);
+
+  if (r != 0 && r != REG_NOMATCH) {
+    freeup(res);
+    apush(makefault("?memory"));
+  }
+  else
+    apush(res);
+  freeup(z);
+  return;
+}
+
+
+/**
+ * The following code implements the nial primitive to find the
+ * first match of one or more regular expressions in a list of strings
+ *
+ *    re_matchmany <patterns> <strings> <options>
+ *
+ * The arguments are as for re_testmany. For a single pattern the
+ * result is an integer table with an offset/length row for each
+ * string. For a list of patterns it is a 3-dimensional integer array
+ * with a plane for each pattern, a row for each string and the
+ * offset/length pair on the last axis. A string that does not match
+ * gives -1 -1.
+ */
+void
+iregexp_matchmany(void)
+{
+  nialptr     z = apop();
+  nialptr     re_pats, re_strings, re_options, res;
+  nialint     npat, i, k, shp[3];
+  int         single, eflags, r = 0;
+  re_entry    **ents;
+  re_lines    lines;
+  regmatch_t  match;
+  char        *msg;
+
+  /* validate the arguments */
+  if (tally(z) != 3 || kind(z) != atype) {
+    apush(makefault("?args"));
+    freeup(z);
+    return;
+  }
+
+  re_pats = fetch_array(z, 0);
+  re_strings = fetch_array(z, 1);
+  re_options = fetch_array(z, 2);
+
+  if (!isint(re_options)) {
+    apush(makefault("?argtypes"));
+    freeup(z);
+    return;
+  }
+
+  ents = re_patterns(re_pats, reg_cflags(intval(re_options)) & ~REG_NOSUB, 1,
+                     &npat, &single, &msg);
+  if (ents == NULL) {
+    apush(makefault(msg));
+    freeup(z);
+    return;
+  }
+
+  if (!re_lines_init(&lines, re_strings)) {
+    re_lines_free(&lines);
+    free(ents);
+    apush(makefault("?argtypes"));
+    freeup(z);
+    return;
+  }
+  shp[0] = npat;
+  shp[1] = lines.n;
+  shp[2] = 2;
+  res = (single ? new_create_array(inttype, 2, 0, &shp[1])
+                : new_create_array(inttype, 3, 0, shp));
+
+  eflags = reg_eflags(intval(re_options));
+  for (i = 0; i < lines.n && (r == 0 || r == REG_NOMATCH); i++) {
+    char *p = re_line(&lines, i);
+
+    for (k = 0; k < npat; k++) {
+      nialint j = 2 * (k * lines.n + i);
+
+      r = re_exec(ents[k], p, &match, eflags);
+      if (r == 0) {
+        store_int(res, j, match.rm_so);
+        store_int(res, j + 1, match.rm_eo - match.rm_so);
+      }
+      else if (r == REG_NOMATCH) {
+        store_int(res, j, -1);
+        store_int(res, j + 1, -1);
+      }
+      else
+        break;
+    }
+  }
+
+  re_lines_free(&lines);
+  free(ents);
+
+  if (r != 0 && r != REG_NOMATCH) {
+    freeup(res);
+    apush(makefault("match failed in regexp search"));
+  }
+  else
+    apush(res);
+  freeup(z);
+  return;
+}
+
+
+/**
+ * The following code implements the nial primitive to empty the
+ * cache of compiled regular expressions and clear all the slots
+ *
+ *    re_clear Null
+ *
+ * It returns the number of compiled expressions released.
+ */
+void
+iregexp_clear(void)
+{
+  nialptr     z = apop();
+  nialint     i, n = re_nentries;
+
+  for (i = 0; i < re_nbuckets; i++) {
+    re_entry *e;
+
+    while ((e = re_buckets[i]) != NULL) {
+      re_buckets[i] = e->next;
+      regfree(&e->re);
+      free(e->literal);
+      free(e->pattern);
+      free(e);
+    }
+  }
+  free(re_buckets);
+  re_buckets = NULL;
+  re_nbuckets = 0;
+  re_nentries = 0;
+
+  free(re_slots);
+  re_slots = NULL;
+  re_nslots = 0;
+
+  apush(createint(n));
+  freeup(z);
+  return;
+}
+
+
 #endif /* ) REGEXP */
 
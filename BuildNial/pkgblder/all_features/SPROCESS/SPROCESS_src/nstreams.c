@@ -1328,6 +1328,169 @@ void inio_block_array(void) {
   return;
 }
 
+/* ------------------------- Framed arrays ------------------------- */
+
+/*
+ * A frame is a serialised array preceded by its length in bytes.
+ * The length lets a reader see that a whole array has arrived
+ * before calling unblock_array, which would otherwise block part
+ * way through a message. Worker pools use frames on their pipes.
+ */
+
+
+/**
+ * Compute the number of bytes block_array will write for x
+ */
+static nialint
+block_size(nialptr x)
+{
+  nialint     k = kind(x),
+              v = valence(x),
+              t,
+              i,
+              n;
+
+  n = (3 + v) * sizeof(nialint);
+  if (k == atype) {
+    t = tally(x);
+    for (i = 0; i < t; i++)
+      n += block_size(fetch_array(x, i));
+    return n;
+  }
+
+  t = (k == phrasetype || k == faulttype) ? (nialint) strlen(pfirstchar(x)) : tally(x);
+  n += sizeof(nialint);
+  switch (k) {
+    case phrasetype:
+    case faulttype:
+        n += tknlength(x) + 1;
+        break;
+    case booltype:
+        n += (t / boolsPW + ((t % boolsPW) == 0 ? 0 : 1)) * sizeof(nialint);
+        break;
+    case chartype:
+        n += t + 1;
+        break;
+    case inttype:
+        n += t * sizeof(nialint);
+        break;
+    case realtype:
+        n += t * sizeof(double);
+        break;
+#ifdef COMPLEX
+    case cplxtype:
+        n += t * 2 * sizeof(double);
+        break;
+#endif
+  }
+  return n;
+}
+
+
+/**
+ * Copy the first len bytes of a stream without removing them
+ */
+static nialint
+peekChars(SP_StreamPtr stream, unsigned char *buff, nialint len)
+{
+  SP_BuffPtr b = stream->first;
+  nialint got = 0;
+
+  while (b != NULL && got < len) {
+    nialint nc = (len - got > b->count) ? b->count : len - got;
+    memcpy(buff + got, b->buff + b->d_start, nc);
+    got += nc;
+    b = b->next;
+  }
+  return got;
+}
+
+
+/**
+ * Append a frame holding x to a stream
+ */
+int nio_write_frame(int ios, nialptr x) {
+  nialint n;
+  SP_StreamPtr sp;
+
+  if (!VALID_STREAM(ios))
+    return -1;
+
+  sp = nio_streams[ios];
+  n = block_size(x);
+  if (appendChars(sp, (unsigned char *) &n, sizeof(nialint)) < 0)
+    return -1;
+  return block_array(sp, x);
+}
+
+
+/**
+ * Read whatever input is available without blocking and report
+ * whether a complete frame is buffered: 1 if it is, 0 if not yet
+ * and -1 if the stream has ended without one.
+ */
+int nio_frame_ready(int ios) {
+  SP_StreamPtr sp;
+  nialint n;
+
+  if (!VALID_STREAM(ios))
+    return -1;
+
+  sp = nio_streams[ios];
+  poll_input(sp, IOS_NOLIMIT, IOS_NO_WAIT);
+  if (sp->count >= (nialint) sizeof(nialint)) {
+    peekChars(sp, (unsigned char *) &n, sizeof(nialint));
+    if (sp->count >= n + (nialint) sizeof(nialint))
+      return 1;
+  }
+  return (sp->status == IOS_EOF) ? -1 : 0;
+}
+
+
+/**
+ * Read the next frame from a stream, waiting for it if necessary.
+ * Returns invalidptr if the stream ends first.
+ */
+nialptr nio_read_frame(int ios) {
+  SP_StreamPtr sp;
+  nialint n;
+
+  if (!VALID_STREAM(ios))
+    return invalidptr;
+
+  sp = nio_streams[ios];
+  if (poll_input(sp, sizeof(nialint), IOS_INDEFINITE_WAIT) < (nialint) sizeof(nialint))
+    return invalidptr;
+  peekChars(sp, (unsigned char *) &n, sizeof(nialint));
+  if (poll_input(sp, n + sizeof(nialint), IOS_INDEFINITE_WAIT) < n + (nialint) sizeof(nialint))
+    return invalidptr;
+  nio_getchars(sp, (unsigned char *) &n, sizeof(nialint));
+  return unblock_array(sp);
+}
+
+
+/**
+ * Write buffered output to the descriptor. With wait set to
+ * IOS_NO_WAIT only what the descriptor accepts now is written;
+ * otherwise this blocks until the stream is empty. Returns the
+ * bytes still buffered or -1 on error.
+ */
+nialint nio_flush(int ios, int wait) {
+  SP_StreamPtr sp;
+
+  if (!VALID_STREAM(ios))
+    return -1;
+
+  sp = nio_streams[ios];
+  do {
+    if (writeStream(sp, wait) < 0)
+      return -1;
+  } while (wait != IOS_NO_WAIT && sp->count > 0 && sp->status != IOS_EOF);
+
+  return (sp->status == IOS_EOF && sp->count > 0) ? -1 : sp->count;
+}
+
+
 
 /**
  * fill an fdset from the input stream list
@@ -66,11 +66,17 @@ extern int  nio_createStream();
 extern void nio_freeStream(int ios);
 
 extern int  nio_set_fd(int ios, int fd);
+extern int  nio_get_fd(int ios);
 extern int  nio_set_mode(int ios, int mode);
 extern int  nio_set_flags(int ios, int mode);
 
 extern void nio_set_nonblock(int fd, int flag);
 
+extern int     nio_write_frame(int ios, nialptr x);
+extern int     nio_frame_ready(int ios);
+extern nialptr nio_read_frame(int ios);
+extern nialint nio_flush(int ios, int wait);
+
 
 /* -------------- Primitives ------------------- */
 
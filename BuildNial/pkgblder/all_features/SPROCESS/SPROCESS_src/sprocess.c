@@ -725,6 +725,690 @@ void ichild_status(void) {
 }
   
 
+/* ========================= Worker Pools ========================= */
+
+/*
+ * A worker pool is a set of forked Nial children that serve jobs
+ * of the form [id, opname, arg] and answer with [id, result]. Both
+ * directions use frames (see nstreams.c) on a pair of pipes. The
+ * parent keeps jobs in a shared queue and only hands a job to a
+ * worker that has fewer than depth jobs outstanding, so an idle
+ * worker always takes the next job and a slow job delays nothing
+ * but the jobs already committed behind it. Submissions block
+ * while the queue holds backlog jobs, which bounds the memory a
+ * fast producer can tie up.
+ *
+ * The loop run by a worker is pool_serve in sprocess.ndf.
+ */
+
+#define MAX_POOLS     64
+#define POOL_DEPTH     1
+#define POOL_BACKLOG  64
+
+typedef struct {
+  nialint id;
+  nialptr val;    /* the job while queued, the result once done */
+} PoolJob;
+
+typedef struct {
+  int      nworkers;
+  int      depth;
+  nialint  backlog;
+  nialint *rd;         /* result stream of each worker */
+  nialint *wr;         /* job stream of each worker */
+  int     *alive;
+  int     *inflight;   /* jobs sent and not yet answered */
+  nialint *sent;       /* ids sent, depth per worker, oldest first */
+  PoolJob *queue;      /* pending jobs as a ring */
+  nialint  qhead, qcount, qsize;
+  PoolJob *done;       /* finished jobs in order of completion */
+  nialint  dcount, dsize;
+  nialint  next_id;
+} WorkerPool, *WorkerPoolPtr;
+
+static WorkerPoolPtr pools[MAX_POOLS];
+
+#define VALID_POOL(i) (0 <= i && i < MAX_POOLS && pools[i] != NULL)
+
+
+static PoolJob *grow_jobs(PoolJob *jobs, nialint *size) {
+  nialint nsize = (*size == 0) ? 16 : 2 * *size;
+  PoolJob *n = (PoolJob *) realloc(jobs, nsize * sizeof(PoolJob));
+  if (n != NULL)
+    *size = nsize;
+  return n;
+}
+
+
+/**
+ * Release a pool. In the parent the job pipes are closed, which
+ * workers see as end of input. A forked worker calls this for every
+ * pool it inherited so that it does not hold other workers' pipes
+ * open.
+ */
+static void pool_free(int pi) {
+  WorkerPoolPtr p = pools[pi];
+  nialint i;
+
+  for (i = 0; i < p->nworkers; i++) {
+    nio_freeStream(p->wr[i]);
+    nio_freeStream(p->rd[i]);
+  }
+
+  for (i = 0; i < p->qcount; i++) {
+    nialptr v = p->queue[(p->qhead + i) % p->qsize].val;
+    decrrefcnt(v);
+    freeup(v);
+  }
+  for (i = 0; i < p->dcount; i++) {
+    decrrefcnt(p->done[i].val);
+    freeup(p->done[i].val);
+  }
+
+  free(p->rd);
+  free(p->wr);
+  free(p->alive);
+  free(p->inflight);
+  free(p->sent);
+  free(p->queue);
+  free(p->done);
+  free(p);
+  pools[pi] = NULL;
+}
+
+
+/**
+ * Record the result of a job
+ */
+static int pool_finish(WorkerPoolPtr p, nialint id, nialptr val) {
+  if (p->dcount == p->dsize) {
+    PoolJob *n = grow_jobs(p->done, &p->dsize);
+    if (n == NULL)
+      return -1;
+    p->done = n;
+  }
+  incrrefcnt(val);
+  p->done[p->dcount].id = id;
+  p->done[p->dcount].val = val;
+  p->dcount++;
+  return 0;
+}
+
+
+/**
+ * A worker can no longer be used. Its outstanding jobs finish with
+ * the given fault.
+ */
+static void pool_drop(WorkerPoolPtr p, int w, char *msg) {
+  nialint j;
+
+  p->alive[w] = 0;
+  for (j = 0; j < p->inflight[w]; j++)
+    pool_finish(p, p->sent[w * p->depth + j], makefault(msg));
+  p->inflight[w] = 0;
+}
+
+
+/**
+ * A worker has gone away. Its outstanding jobs finish with a fault.
+ */
+static void pool_lost(WorkerPoolPtr p, int w) {
+  pool_drop(p, w, "?worker_lost");
+}
+
+
+/**
+ * Hand queued jobs to workers with spare capacity, least loaded first
+ */
+static void pool_dispatch(WorkerPoolPtr p) {
+  while (p->qcount > 0) {
+    int w, best = -1;
+    PoolJob *job;
+    nialint ios;
+
+    for (w = 0; w < p->nworkers; w++)
+      if (p->alive[w] && p->inflight[w] < p->depth &&
+          (best < 0 || p->inflight[w] < p->inflight[best]))
+        best = w;
+    if (best < 0)
+      return;
+
+    job = &p->queue[p->qhead];
+    ios = p->wr[best];
+    if (nio_write_frame(ios, job->val) < 0 || nio_flush(ios, IOS_NO_WAIT) < 0) {
+      pool_lost(p, best);
+      continue;
+    }
+
+    p->sent[best * p->depth + p->inflight[best]] = job->id;
+    p->inflight[best]++;
+    decrrefcnt(job->val);
+    freeup(job->val);
+    p->qhead = (p->qhead + 1) % p->qsize;
+    p->qcount--;
+  }
+}
+
+
+/**
+ * Take the frames waiting from worker w
+ */
+static void pool_receive(WorkerPoolPtr p, int w) {
+  nialint ios = p->rd[w];
+  int ready;
+
+  while ((ready = nio_frame_ready(ios)) == 1) {
+    nialptr r = nio_read_frame(ios);
+    nialint j;
+
+    if (r == invalidptr || kind(r) != atype || tally(r) != 2 ||
+        kind(fetch_array(r, 0)) != inttype || p->inflight[w] == 0) {
+      if (r != invalidptr)
+        freeup(r);
+      pool_lost(p, w);
+      return;
+    }
+
+    /* the worker answers in order, anything else means it is out of step */
+    if (intval(fetch_array(r, 0)) != p->sent[w * p->depth]) {
+      freeup(r);
+      pool_drop(p, w, "?reply_mismatch");
+      return;
+    }
+
+    pool_finish(p, intval(fetch_array(r, 0)), fetch_array(r, 1));
+    freeup(r);
+
+    /* drop the oldest id */
+    for (j = 1; j < p->inflight[w]; j++)
+      p->sent[w * p->depth + j - 1] = p->sent[w * p->depth + j];
+    p->inflight[w]--;
+  }
+
+  if (ready < 0)
+    pool_lost(p, w);
+}
+
+
+/**
+ * Move jobs and results along. With wait set this blocks until
+ * something happens; otherwise it only does what is possible now.
+ * Returns 0 if nothing is outstanding in the workers.
+ */
+static int pool_pump(WorkerPoolPtr p, int wait) {
+  fd_set rfds, wfds;
+  struct timeval zero;
+  int w, fd, maxfd = -1;
+
+  pool_dispatch(p);
+
+  FD_ZERO(&rfds);
+  FD_ZERO(&wfds);
+  for (w = 0; w < p->nworkers; w++) {
+    if (!p->alive[w] || p->inflight[w] == 0)
+      continue;
+    fd = nio_get_fd(p->rd[w]);
+    FD_SET(fd, &rfds);
+    if (fd > maxfd)
+      maxfd = fd;
+    if (nio_flush(p->wr[w], IOS_NO_WAIT) > 0) {
+      fd = nio_get_fd(p->wr[w]);
+      FD_SET(fd, &wfds);
+      if (fd > maxfd)
+        maxfd = fd;
+    }
+  }
+
+  if (maxfd < 0)
+    return 0;
+
+  zero.tv_sec = 0;
+  zero.tv_usec = 0;
+  if (select(maxfd + 1, &rfds, &wfds, NULL, wait ? NULL : &zero) < 0)
+    return 1;   /* interrupted, the caller will come round again */
+
+  for (w = 0; w < p->nworkers; w++) {
+    if (!p->alive[w] || p->inflight[w] == 0)
+      continue;
+    if (FD_ISSET(nio_get_fd(p->rd[w]), &rfds))
+      pool_receive(p, w);
+  }
+
+  pool_dispatch(p);
+  return 1;
+}
+
+
+/**
+ * Remove the k-th finished job and return it as [id, result]
+ */
+static nialptr pool_take_done(WorkerPoolPtr p, nialint k) {
+  nialptr z, v = p->done[k].val;
+  nialint id = p->done[k].id, two = 2;
+
+  memmove(&p->done[k], &p->done[k + 1], (p->dcount - k - 1) * sizeof(PoolJob));
+  p->dcount--;
+
+  z = new_create_array(atype, 1, 0, &two);
+  store_array(z, 0, createint(id));
+  store_array(z, 1, v);
+  decrrefcnt(v);
+  return z;
+}
+
+
+/**
+ * Is the job id still owed by the pool?
+ */
+static int pool_owes(WorkerPoolPtr p, nialint id) {
+  nialint i;
+  int w;
+
+  for (i = 0; i < p->qcount; i++)
+    if (p->queue[(p->qhead + i) % p->qsize].id == id)
+      return 1;
+  for (w = 0; w < p->nworkers; w++)
+    for (i = 0; i < p->inflight[w]; i++)
+      if (p->sent[w * p->depth + i] == id)
+        return 1;
+  return 0;
+}
+
+
+/**
+ * Start a pool of worker processes
+ *
+ * pool_fork N [Depth [Backlog]]
+ *
+ * In the parent this returns the pool number. In each worker it
+ * returns the channel [reader, writer] on which jobs arrive and
+ * results are sent back.
+ */
+void ipool_fork(void) {
+  nialptr x = apop();
+  nialint n, depth = POOL_DEPTH, backlog = POOL_BACKLOG;
+  int pi, w;
+  WorkerPoolPtr p;
+
+  if (kind(x) != inttype || tally(x) < 1 || tally(x) > 3) {
+    apush(makefault("?args"));
+    freeup(x);
+    return;
+  }
+
+  n = fetch_int(x, 0);
+  if (tally(x) > 1)
+    depth = fetch_int(x, 1);
+  if (tally(x) > 2)
+    backlog = fetch_int(x, 2);
+  freeup(x);
+
+  if (n < 1 || depth < 1 || backlog < 1) {
+    apush(makefault("?args"));
+    return;
+  }
+
+  for (pi = 0; pi < MAX_POOLS && pools[pi] != NULL; pi++);
+  if (pi == MAX_POOLS) {
+    apush(makefault("?too_many_pools"));
+    return;
+  }
+
+  p = (WorkerPoolPtr) calloc(1, sizeof(WorkerPool));
+  if (p == NULL) {
+    apush(makefault("?nomem"));
+    return;
+  }
+  p->nworkers = 0;
+  p->depth = depth;
+  p->backlog = backlog;
+  p->rd = (nialint *) malloc(n * sizeof(nialint));
+  p->wr = (nialint *) malloc(n * sizeof(nialint));
+  p->alive = (int *) calloc(n, sizeof(int));
+  p->inflight = (int *) calloc(n, sizeof(int));
+  p->sent = (nialint *) malloc(n * depth * sizeof(nialint));
+  pools[pi] = p;
+  if (p->rd == NULL || p->wr == NULL || p->alive == NULL || p->inflight == NULL || p->sent == NULL) {
+    pool_free(pi);
+    apush(makefault("?nomem"));
+    return;
+  }
+
+  for (w = 0; w < n; w++) {
+    int jobfd[2], resfd[2];
+    nialint child, rd, wr;
+    pid_t childpid;
+
+    /* the child slot is only for reaping, the pool has its own streams */
+    child = assignChild(-1, -1);
+    rd = nio_createStream();
+    wr = nio_createStream();
+    if (child < 0 || rd < 0 || wr < 0) {
+      if (child >= 0) releaseChild(child);
+      nio_freeStream(rd);
+      nio_freeStream(wr);
+      pool_free(pi);
+      apush(makefault("?nomem"));
+      return;
+    }
+    if (pipe(jobfd) < 0) {
+      releaseChild(child);
+      nio_freeStream(rd);
+      nio_freeStream(wr);
+      pool_free(pi);
+      apush(makefault("?syserror"));
+      return;
+    }
+    if (pipe(resfd) < 0) {
+      close(jobfd[0]);
+      close(jobfd[1]);
+      releaseChild(child);
+      nio_freeStream(rd);
+      nio_freeStream(wr);
+      pool_free(pi);
+      apush(makefault("?syserror"));
+      return;
+    }
+
+    if ((childpid = fork()) < 0) {
+      close(jobfd[0]);
+      close(jobfd[1]);
+      close(resfd[0]);
+      close(resfd[1]);
+      releaseChild(child);
+      nio_freeStream(rd);
+      nio_freeStream(wr);
+      pool_free(pi);
+      apush(makefault("?syserror"));
+      return;
+    }
+
+    if (childpid == 0) {
+      /* in the worker: drop everything belonging to the parent's pools */
+      nialint two = 2;
+      nialptr chan;
+      int i;
+
+      close(jobfd[1]);
+      close(resfd[0]);
+      releaseChild(child);
+      for (i = 0; i < MAX_POOLS; i++)
+        if (pools[i] != NULL)
+          pool_free(i);
+
+      nio_set_fd(rd, jobfd[0]);
+      nio_set_fd(wr, resfd[1]);
+
+      set_non_interactive();
+
+      chan = new_create_array(inttype, 1, 0, &two);
+      store_int(chan, 0, rd);
+      store_int(chan, 1, wr);
+      apush(chan);
+      return;
+    }
+
+    /* in the parent */
+    close(jobfd[0]);
+    close(resfd[1]);
+    nio_set_nonblock(jobfd[1], 1);
+    children[child]->child = childpid;
+    children[child]->child_flags = UNMANAGED_CHILD;
+    nio_set_fd(wr, jobfd[1]);
+    nio_set_fd(rd, resfd[0]);
+    p->rd[w] = rd;
+    p->wr[w] = wr;
+    p->alive[w] = 1;
+    p->nworkers++;
+  }
+
+  apush(createint(pi));
+}
+
+
+/**
+ * Queue a job, returning its id
+ *
+ * pool_submit Pool Opname Arg
+ */
+void ipool_submit(void) {
+  nialptr x = apop();
+  nialptr job;
+  nialint pi, three = 3;
+  WorkerPoolPtr p;
+  int w, live = 0;
+
+  if (kind(x) != atype || tally(x) != 3 || kind(fetch_array(x, 0)) != inttype) {
+    apush(makefault("?args"));
+    freeup(x);
+    return;
+  }
+
+  pi = intval(fetch_array(x, 0));
+  if (!VALID_POOL(pi)) {
+    apush(makefault("?invalid_pool"));
+    freeup(x);
+    return;
+  }
+  p = pools[pi];
+
+  /* back-pressure: wait for room in the queue */
+  while (p->qcount >= p->backlog && pool_pump(p, 1));
+
+  for (w = 0; w < p->nworkers; w++)
+    live += p->alive[w];
+  if (live == 0) {
+    apush(makefault("?no_workers"));
+    freeup(x);
+    return;
+  }
+
+  if (p->qcount == p->qsize) {
+    /* grow the ring, unwrapping it into the new space */
+    nialint osize = p->qsize, i;
+    PoolJob *n = grow_jobs(p->queue, &p->qsize);
+    if (n == NULL) {
+      apush(makefault("?nomem"));
+      freeup(x);
+      return;
+    }
+    p->queue = n;
+    for (i = 0; i < p->qhead; i++)
+      p->queue[osize + i] = p->queue[i];
+    if (p->qhead > 0)
+      memmove(p->queue, p->queue + p->qhead, p->qcount * sizeof(PoolJob));
+    p->qhead = 0;
+  }
+
+  job = new_create_array(atype, 1, 0, &three);
+  store_array(job, 0, createint(p->next_id));
+  store_array(job, 1, fetch_array(x, 1));
+  store_array(job, 2, fetch_array(x, 2));
+  incrrefcnt(job);
+  p->queue[(p->qhead + p->qcount) % p->qsize].id = p->next_id;
+  p->queue[(p->qhead + p->qcount) % p->qsize].val = job;
+  p->qcount++;
+
+  pool_pump(p, 0);
+
+  apush(createint(p->next_id++));
+  freeup(x);
+}
+
+
+/**
+ * Collect a result as [id, result]
+ *
+ * pool_collect Pool      - the next job to finish
+ * pool_collect Pool Id   - the given job
+ *
+ * Waits if the result is not ready. Returns Null when the pool
+ * owes nothing more.
+ */
+void ipool_collect(void) {
+  nialptr x = apop();
+  nialint pi, id = -1, k;
+  WorkerPoolPtr p;
+
+  if (kind(x) != inttype || tally(x) < 1 || tally(x) > 2) {
+    apush(makefault("?args"));
+    freeup(x);
+    return;
+  }
+
+  pi = fetch_int(x, 0);
+  if (tally(x) == 2)
+    id = fetch_int(x, 1);
+  freeup(x);
+
+  if (!VALID_POOL(pi)) {
+    apush(makefault("?invalid_pool"));
+    return;
+  }
+  p = pools[pi];
+
+  for (;;) {
+    if (id < 0) {
+      if (p->dcount > 0) {
+        apush(pool_take_done(p, 0));
+        return;
+      }
+    } else {
+      for (k = 0; k < p->dcount; k++)
+        if (p->done[k].id == id) {
+          apush(pool_take_done(p, k));
+          return;
+        }
+      if (!pool_owes(p, id)) {
+        apush(makefault("?unknown_job"));
+        return;
+      }
+    }
+
+    if (!pool_pump(p, 1) && p->dcount == 0 && (id >= 0 || p->qcount == 0)) {
+      /* nothing in flight and nothing that can be sent */
+      apush(id < 0 ? Null : makefault("?no_workers"));
+      return;
+    }
+  }
+}
+
+
+/**
+ * Make progress without waiting and report the pool state as
+ * [live workers, queued, in flight, finished]
+ *
+ * pool_poll Pool
+ */
+void ipool_poll(void) {
+  nialptr x = apop();
+  nialptr res;
+  nialint pi, live = 0, busy = 0, four = 4;
+  WorkerPoolPtr p;
+  int w;
+
+  if (kind(x) != inttype || !VALID_POOL(intval(x))) {
+    apush(makefault("?invalid_pool"));
+    freeup(x);
+    return;
+  }
+
+  pi = intval(x);
+  p = pools[pi];
+  pool_pump(p, 0);
+
+  for (w = 0; w < p->nworkers; w++) {
+    live += p->alive[w];
+    busy += p->inflight[w];
+  }
+
+  res = new_create_array(inttype, 1, 0, &four);
+  store_int(res, 0, live);
+  store_int(res, 1, p->qcount);
+  store_int(res, 2, busy);
+  store_int(res, 3, p->dcount);
+  apush(res);
+  freeup(x);
+}
+
+
+/**
+ * Shut a pool down. Workers see the end of their job stream and
+ * exit; queued jobs and uncollected results are discarded.
+ *
+ * pool_close Pool
+ */
+void ipool_close(void) {
+  nialptr x = apop();
+
+  if (kind(x) != inttype || !VALID_POOL(intval(x))) {
+    apush(makefault("?invalid_pool"));
+    freeup(x);
+    return;
+  }
+
+  pool_free(intval(x));
+  apush(True_val);
+  freeup(x);
+}
+
+
+/**
+ * In a worker, wait for the next job on a pool channel. Returns
+ * [id, opname, arg], or Null once the parent closes the pool.
+ *
+ * pool_take Chan
+ */
+void ipool_take(void) {
+  nialptr x = apop();
+  nialptr job;
+
+  if (kind(x) != inttype || tally(x) != 2) {
+    apush(makefault("?args"));
+    freeup(x);
+    return;
+  }
+
+  job = nio_read_frame(fetch_int(x, 0));
+  apush(job == invalidptr ? Null : job);
+  freeup(x);
+}
+
+
+/**
+ * In a worker, send the result of a job back to the parent
+ *
+ * pool_reply Chan Id Result
+ */
+void ipool_reply(void) {
+  nialptr x = apop();
+  nialptr chan, res;
+  nialint ios, two = 2;
+
+  if (kind(x) != atype || tally(x) != 3 ||
+      kind(fetch_array(x, 0)) != inttype || tally(fetch_array(x, 0)) != 2 ||
+      kind(fetch_array(x, 1)) != inttype) {
+    apush(makefault("?args"));
+    freeup(x);
+    return;
+  }
+
+  chan = fetch_array(x, 0);
+  ios = fetch_int(chan, 1);
+
+  res = new_create_array(atype, 1, 0, &two);
+  store_array(res, 0, fetch_array(x, 1));
+  store_array(res, 1, fetch_array(x, 2));
+  if (nio_write_frame(ios, res) < 0 || nio_flush(ios, IOS_INDEFINITE_WAIT) < 0) {
+    apush(False_val);
+  } else {
+    apush(True_val);
+  }
+  freeup(res);
+  freeup(x);
+}
+
+
 /* ---------------------- fast timer/sleep ----------------- */
 
 
@@ -92,12 +92,19 @@ static void setup_heap(void);
 static void remove_atom(nialptr x);
 static void rehash(nialint tblsize);
 static void allocate_Cbuffer(void);
+static void logtemp(nialptr bx);
+static void droptemp(nialptr bx);
+static void queuefree(nialptr x);
+static void letgo(nialptr it);
+static void freework(nialint budget);
 
 /*
   static char * my_realloc(char *x,nialint newsize,nialint oldsize);
 */
 
 static void allocate_atomtbl(void);
+static nialint sort_freelist(void);
+static int  heap_fragmented(void);
 
 /*
  * Bitmasks to simplify boolean operations on vectors
@@ -220,6 +227,30 @@ static int  firsttry = true; /* flag to monitor heap expansion tries in
 /* C buffer variables */
 static nialint Cbuffersize;  /* current size of the C buffer */
 
+/* temporaries log variables, see cleartemps */
+#ifdef INTS64
+#define tmpslot(bx) ((nialhdr*)&mem[bx])->hdrdata.allocatedblock.flags.skv.slot
+#define TEMPLOGINIT 4096
+
+static nialptr *templog = NULL;  /* blocks created since marktemps */
+static nialint templen = 0,  /* entries in use */
+            tempcap = 0;     /* entries allocated */
+#endif
+static int  tempsweep = false;  /* the log could not grow, sweep instead */
+static int  fullsweep = false;  /* set by setsweep */
+
+/* free queue variables, see freework */
+#define FREEBUDGET 256       /* items handled per portion */
+
+struct freeentry {
+  nialptr     arr;           /* array being freed */
+  nialint     next;          /* index of its next item to be let go */
+};
+
+static struct freeentry *freeq = NULL;
+static nialint freeqlen = 0,
+            freeqcap = 0;
+
 /* global variables used to turn on debugging selectively */
 int doprintf = false;
 nialptr globalx;
@@ -267,6 +298,7 @@ fetch_bool(nialptr x, nialint i)
 void
 setup_abstract_machine(nialint initialmemsize)
 {
+  marktemps();
   allocate_heap(initialmemsize);  /* do heap first since the other areas are
                                    * allocated from it. */
   allocate_stack();
@@ -282,10 +314,116 @@ clear_abstract_machine()
   deallocate_heap();         /* clears all since others are within it. */
   free(Cbuffer);
   Cbuffer = NULL;
+#ifdef INTS64
+  free(templog);
+  templog = NULL;
+  tempcap = 0;
+#endif
+  marktemps();
+  freeqlen = 0;
 }
 
 /*  Heap management routines.  */
 
+#ifdef RESERVEDHEAP
+
+/* The heap is placed at the front of a range of address space reserved
+   with mmap. Only the first heapcommitted bytes are accessible; growing
+   the heap makes more of the range accessible, so mem never moves and
+   an expansion costs only the page faults on the new space. The range is
+   sized by maxmemsize (-maxsize on the command line). When the range is
+   used up the heap is copied to a new range twice the size it needs, and
+   if the reservation cannot be made the heap falls back to malloc and
+   realloc. */
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+static char *heapbase = NULL;  /* start of the reserved range or NULL */
+static size_t heapreserved;    /* bytes reserved */
+static size_t heapcommitted;   /* bytes at the front that are usable */
+static size_t pagesize;
+
+#define round_to_page(n) (((n) + pagesize - 1) & ~(pagesize - 1))
+
+/* make the first nbytes of the reservation usable */
+
+static int
+commit_heap(size_t nbytes)
+{
+  size_t      want = round_to_page(nbytes);
+
+  if (want <= heapcommitted)
+    return 0;
+  if (want > heapreserved ||
+      mprotect(heapbase + heapcommitted, want - heapcommitted, PROT_READ | PROT_WRITE) != 0)
+    return -1;
+  heapcommitted = want;
+  return 0;
+}
+
+/* reserve room for limit words and commit the first memsize of them */
+
+static void
+reserve_heap(nialint limit)
+{
+  void       *p;
+
+  pagesize = (size_t) sysconf(_SC_PAGESIZE);
+  heapreserved = round_to_page((size_t) limit * sizeof(nialword));
+  heapcommitted = 0;
+  p = mmap(NULL, heapreserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED)
+    return;
+  heapbase = (char *) p;
+  if (commit_heap(memsize * sizeof(nialword)) != 0) {
+    munmap(heapbase, heapreserved);
+    heapbase = NULL;
+  }
+}
+
+/* move the heap to a new area of nwords words once the reservation is
+   used up. A new reservation is tried first so that later expansions are
+   still done in place, otherwise the heap is moved to a malloc area.
+   Returns -1 if neither can be had, leaving the heap where it was. */
+
+static int
+move_heap(nialint nwords)
+{
+  char       *oldbase = heapbase;
+  size_t      oldreserved = heapreserved,
+              oldcommitted = heapcommitted;
+  nialword   *newmem;
+
+  heapbase = NULL;
+  reserve_heap(2 * nwords);
+  if (heapbase != NULL && commit_heap(nwords * sizeof(nialword)) == 0)
+    newmem = (nialword *) heapbase;
+  else {
+    if (heapbase != NULL)
+      munmap(heapbase, heapreserved);
+    heapbase = NULL;
+    newmem = (nialword *) malloc(nwords * sizeof(nialword));
+  }
+  if (newmem == NULL) {
+    heapbase = oldbase;
+    heapreserved = oldreserved;
+    heapcommitted = oldcommitted;
+    return -1;
+  }
+  memcpy(newmem, mem, memsize * sizeof(nialword));
+  munmap(oldbase, oldreserved);
+  mem = newmem;
+  reset_absmach();
+  return 0;
+}
+
+#endif /* RESERVEDHEAP */
+
 
 /* routine to allocate the heap as a contiguous block of nialptrs or words */
 
@@ -327,6 +465,14 @@ allocate_heap(nialint initialmemsize)
   {
 
     memsize = initialmemsize;
+#ifdef RESERVEDHEAP
+    /* a fixed size heap only needs room for the recovery expansion */
+    reserve_heap(expansion ? (maxmemsize > memsize ? maxmemsize : memsize)
+                 : memsize + MINHEAPSPACE + 100);
+    if (heapbase != NULL)
+      mem = (nialword *) heapbase;
+    else
+#endif
     mem = (nialword *) malloc(memsize * sizeof(nialword));
     if (mem == NULL) {         /* malloc failed */
       printf("unable to allocate heap of requested size");
@@ -348,6 +494,13 @@ deallocate_heap()
     munmap(mem, memsize*sizeof(nialint));
   else
 #endif
+#ifdef RESERVEDHEAP
+  if (heapbase != NULL) {
+    munmap(heapbase, heapreserved);
+    heapbase = NULL;
+  }
+  else
+#endif
       
     free(mem);
 }
@@ -467,9 +620,12 @@ setup_heap()
    space needs of the clean up process can be met. If this fails then
    the session is terminated, otherwise an infinite loop can be caused.
 
-   The expansion is done with a realloc with the hope that the current
-   area can be extended in place without copying on some operating systems.
-   If the realloc fails then control jumps to top level with a warning.
+   When the heap is in a reserved range the expansion commits more of the
+   range in place, trimmed to what is left of the reservation. If the
+   range has no room for the request the heap is moved. Otherwise
+   it is done with a realloc with the hope that the current area can be
+   extended in place without copying on some operating systems.
+   If the expansion fails then control jumps to top level with a warning.
    If expansions continue to be called, and a recovery routine is
    present then a limit is placed on the number of recoveries attempted
    to avoid an infinite recovery loop.
@@ -503,17 +659,39 @@ expand_heap(nialint n)
     memincr = ALIGNED_WORD_COUNT(memincr);   /* ensure even sized memarea */
     nprintf(OF_MESSAGE_LOG, "expanding heap to %d words\n", memsize + memincr);
   }
+  /* put the free list in address order so that the new space is used
+     after the holes below it */
+  if (heap_fragmented())
+    sort_freelist();
   mspace = (memsize + memincr) * (sizeof(nialword));
-  newmem = (nialword *) my_realloc((char *) mem, mspace, memsize * (sizeof(nialword)));
-
-  if (newmem == NULL) {      /* the realloc has failed */
-    exit_cover1("heap expansion failed",NC_WARNING);
+#ifdef RESERVEDHEAP
+  if (heapbase != NULL) {
+    nialint     room = heapreserved / sizeof(nialword) - memsize;
+
+    if (memincr > room && room >= n + MINHEAPSPACE)
+      memincr = room;
+    if (memincr > room) {
+      if (move_heap(memsize + memincr) != 0)
+        exit_cover1("heap expansion failed", NC_WARNING);
+    }
+    else
+    if (commit_heap((memsize + memincr) * sizeof(nialword)) != 0)
+      exit_cover1("heap expansion failed", NC_WARNING);
   }
-  /* reset mem to the new area */
-  if (mem != newmem) {       /* the heap has moved. Change mem and reset all
-                              * explicit pointers */
-    mem = newmem;
-    reset_absmach();
+  else
+#endif
+  {
+    newmem = (nialword *) my_realloc((char *) mem, mspace, memsize * (sizeof(nialword)));
+
+    if (newmem == NULL) {      /* the realloc has failed */
+      exit_cover1("heap expansion failed",NC_WARNING);
+    }
+    /* reset mem to the new area */
+    if (mem != newmem) {       /* the heap has moved. Change mem and reset all
+                                * explicit pointers */
+      mem = newmem;
+      reset_absmach();
+    }
   }
   /* new block of size memincr starts at old memsize */
   newblk = memsize;
@@ -525,6 +703,238 @@ expand_heap(nialint n)
                               * mem */
 }
 
+/* routine to give the pages inside a free block at the top of the heap
+   back to the operating system. The block stays on the free list; only its
+   header and trailer words are kept and its other pages come back zero
+   filled when the space is used again. Returns the number of bytes
+   released. */
+
+nialint
+trim_heap(void)
+{
+#ifdef RESERVEDHEAP
+  nialptr     b;
+  size_t      lo,
+              hi;
+
+  if (heapbase == NULL || !isprevfree(memsize))
+    return 0;
+  b = prevblk(memsize);
+  if (!isfree(b) || b + blksize(b) != memsize)
+    return 0;
+  lo = round_to_page((size_t) (&mem[b] + minsize));
+  hi = ((size_t) & mem[memsize - 1]) & ~(pagesize - 1);
+  if (hi <= lo || madvise((void *) lo, hi - lo, MADV_DONTNEED) != 0)
+    return 0;
+  return (nialint) (hi - lo);
+#else
+  return 0;
+#endif
+}
+
+/* routine to implement the expression trimheap, which releases the unused
+   space at the top of the heap to the operating system */
+
+void
+itrimheap(void)
+{
+  apush(createint(trim_heap()));
+}
+
+
+/* Free space consolidation.
+
+   Blocks are never moved: array addresses are also held as plain integers
+   (parse trees record symbol table entries that way) and in C variables
+   across calls, so the allocator cannot find every reference to a block.
+   The heap is instead defragmented through placement. compact_heap puts
+   the free list in address order, so first fit fills the lowest holes and
+   live data settles towards the bottom of the heap, and then cuts the free
+   tail off the heap and returns it to the operating system. */
+
+static int
+cmp_blocks(const void *a, const void *b)
+{
+  nialptr     x = *(const nialptr *) a,
+              y = *(const nialptr *) b;
+
+  return (x < y ? -1 : x > y);
+}
+
+/* routine to put the free list in address order. The locked trailer block
+   stays at the end. Returns the number of free blocks. */
+
+static nialint
+sort_freelist(void)
+{
+  nialptr    *blocks,
+              p,
+              prev,
+              locked = TERMINATOR;
+  nialint     cnt = 0,
+              i;
+
+  for (p = fwdlink(freelisthdr); p != TERMINATOR; p = fwdlink(p))
+    cnt++;
+  blocks = (nialptr *) malloc(cnt * sizeof(nialptr));
+  if (blocks == NULL)
+    return cnt;              /* leave the list as it is */
+
+  i = 0;
+  for (p = fwdlink(freelisthdr); p != TERMINATOR; p = fwdlink(p)) {
+    if (islocked(p))
+      locked = p;
+    else
+      blocks[i++] = p;
+  }
+  cnt = i;
+  qsort(blocks, cnt, sizeof(nialptr), cmp_blocks);
+
+  prev = freelisthdr;
+  for (i = 0; i < cnt; i++) {
+    fwdlink(prev) = blocks[i];
+    bcklink(blocks[i]) = prev;
+    prev = blocks[i];
+  }
+  fwdlink(prev) = locked;
+  if (locked != TERMINATOR) {
+    bcklink(locked) = prev;
+    fwdlink(locked) = TERMINATOR;
+  }
+  free(blocks);
+  return cnt;
+}
+
+/* routine to cut a free block at the top of the heap back so that the heap
+   is no larger than its initial size or the space in use plus MINHEAPSPACE.
+   Returns the number of words removed. */
+
+static nialint
+truncate_heap(void)
+{
+#ifdef RESERVEDHEAP
+  nialptr     b;
+  nialint     newsize;
+  size_t      keep;
+
+  if (heapbase == NULL || !isprevfree(memsize))
+    return 0;
+  b = prevblk(memsize);
+  if (!isfree(b) || b + blksize(b) != memsize)
+    return 0;
+
+  newsize = b + MINHEAPSPACE;
+  if (newsize < initmemsize)
+    newsize = initmemsize;
+  keep = round_to_page((size_t) newsize * sizeof(nialword));
+  newsize = keep / sizeof(nialword);
+  if (newsize >= memsize)
+    return 0;
+
+  blksize(b) = newsize - b;
+  set_endinfo(b);
+  newsize = memsize - newsize;
+  memsize -= newsize;
+
+  madvise(heapbase + keep, heapcommitted - keep, MADV_DONTNEED);
+  mprotect(heapbase + keep, heapcommitted - keep, PROT_NONE);
+  heapcommitted = keep;
+  return newsize;
+#else
+  return 0;
+#endif
+}
+
+/* routine to test whether the free space outside the largest free block
+   has passed compactlimit percent of the heap */
+
+static int
+heap_fragmented(void)
+{
+  nialptr     p;
+  nialint     total = 0,
+              largest = 0;
+
+  if (compactlimit <= 0)
+    return false;
+  for (p = fwdlink(freelisthdr); p != TERMINATOR; p = fwdlink(p)) {
+    total += blksize(p);
+    if (blksize(p) > largest)
+      largest = blksize(p);
+  }
+  return ((total - largest) * 100 >= compactlimit * memsize);
+}
+
+/* routine to compact the heap. Returns the number of free blocks. The
+   number of words given back is stored through released if it is not NULL */
+
+nialint
+compact_heap(nialint * released)
+{
+  nialint     cnt,
+              cut;
+
+  flushfree();
+  cnt = sort_freelist();
+  cut = truncate_heap();
+
+  trim_heap();
+  if (released != NULL)
+    *released = cut;
+  return cnt;
+}
+
+/* routine called from the top level loop to compact the heap when the
+   fragmentation limit set by setcompact has been passed */
+
+void
+autocompact(void)
+{
+  if (heap_fragmented())
+    compact_heap(NULL);
+}
+
+/* routine to implement the expression compact.
+   It returns the number of free blocks and the number of words given
+   back to the operating system. */
+
+void
+icompact(void)
+{
+  nialptr     z;
+  nialint     cnt,
+              cut,
+              two = 2;
+
+  cnt = compact_heap(&cut);
+  z = new_create_array(inttype, 1, 0, &two);
+  store_int(z, 0, cnt);
+  store_int(z, 1, cut);
+  apush(z);
+}
+
+/* routine to implement the operation setcompact.
+   setcompact N turns on automatic compaction when more than N percent of
+   the heap is free space outside the largest free block. 0 turns it off.
+   The old setting is returned. */
+
+void
+isetcompact(void)
+{
+  nialptr     x = apop();
+  nialint     old = compactlimit;
+
+  if (!atomic(x) || kind(x) != inttype || intval(x) < 0 || intval(x) > 100) {
+    apush(makefault("?setcompact expects a percentage"));
+    freeup(x);
+    return;
+  }
+  compactlimit = intval(x);
+  apush(createint(old));
+  freeup(x);
+}
+
+
 /* routine to reset the explicit global C pointers into the heap area. */
 
 void
@@ -545,6 +955,7 @@ reset_absmach(void)
    The size may be bigger than required to avoid memory chunks
    too small to be blocks.
    It is only called from new_create_array.
+   The new block is recorded in the temporaries log, see cleartemps.
 
    The space is allocated on a first fit basis from a free list
    that is doublly linked. If the space left in a chosen block is
@@ -575,7 +986,7 @@ reserve(nialint n)
     longjmp(error_env, NC_WARNING);
         
   }
-    
+
  retry:                       /* come back here after expanding heap */
 #ifdef DEBUG
   chkfl();                   /* debugging test to check that free list is OK */
@@ -596,6 +1007,10 @@ reserve(nialint n)
   if (nextfree == TERMINATOR) { /* no block large enough *//* expand the
 							    * heap by enough to accomodate the requested
 							    * block */
+    if (freeqlen > 0) {      /* finish the queued freeing first */
+      flushfree();
+      goto retry;
+    }
     expand_heap(n);
     checksignal(NC_CS_NORMAL);
     goto retry;              /* we can assume that expand_heap has worked
@@ -650,6 +1065,7 @@ reserve(nialint n)
 #endif
   reset_freetag(nextfree);   /* zeros the refcnt also */
   reset_endinfo(nextfree);   /* marks the block to be allocated */
+  logtemp(nextfree);         /* record it as a temporary */
 #ifdef DEBUG
 # ifdef INTS32
   if (nextfree % 2 != 0) {   /* check that block is on even index boundary */
@@ -714,6 +1130,7 @@ release(nialptr x)
     sz;
 
   x = blockptr(x);
+  droptemp(x);
 
 #ifdef NIP_DELAY_RELEASE
   /* Check if we are holding back release of blocks */
@@ -884,9 +1301,10 @@ nialint set_delayed_release_flag(nialint flag) {
    When FREEUPMACRO is set it is only called with refcnt = 0. If
    it is not set freeit must test the refcnt.
 
-   For an array containing references to other arrays, their reference
-   counts are reduced and freeit called recursively. For phrases and faults
-   the corresponding entry in the hash table is also removed. */
+   For an array containing references to other arrays, the array is put
+   on the free queue and their reference counts are reduced by freework,
+   a bounded number at a time, see below. For phrases and faults the
+   corresponding entry in the hash table is also removed. */
 
 
 void
@@ -947,16 +1365,6 @@ freeit(nialptr x)
   }
 #endif
 
-  /* check for stack / heap clash */
-   
-  if (CSTACKFULL)  {
-    printf("C stack full in freeit\n)");
-        
-    longjmp(error_env, NC_WARNING);
-        
-  }
- 
-
 #ifndef FREEUPMACRO
   /* the refcnt test is already true if freeit has been called
      from the macro. */
@@ -967,30 +1375,19 @@ freeit(nialptr x)
 
   k = kind(x);
   if (k == atype) {          /* items are arrays to be freed if possible */
-    nialptr     it;
-    nialptr    *topx = (nialptr*)pfirstitem(x); /* safe: no expansion done */
     nialint     i,
-      tlx = tally(x);
-
-
-    for (i = 0; i < tlx; i++) {
-      it = *topx++;
-#ifdef DEBUG
-      if (it == 0) {
-        nprintf(OF_DEBUG, "invalid item of 0 in an atype, aborting\n");
-        nabort(NC_ABORT);
-      }
-#endif
-      if (it != invalidptr &&/* unused portions of atype arrays */
-          refcnt(it) > 0) {  /* it could possibly be 0 due to aborted freeit
-                              * done earlier. The abort can occur if freeit
-                              * is freeing a very deep array and the C stack
-                              * gets used up */
-        decrrefcnt(it);
-        if (refcnt(it) == 0)
-          freeit(it);
-      }
+                tlx = tally(x);
+
+    if (tlx > FREEBUDGET)
+      queuefree(x);
+    else {                   /* small enough to let go of its items now */
+      for (i = 0; i < tlx; i++)
+        letgo(*((nialptr *) pfirstitem(x) + i));
+      release(x);
     }
+    if (freeqlen > 0)
+      freework(FREEBUDGET);
+    return;
   }
   else if (k == phrasetype || k == faulttype) /* Adjust hash table address */
     remove_atom(x);
@@ -999,9 +1396,109 @@ freeit(nialptr x)
 }
 
 
+/* The free queue.
+
+   Freeing an array of arrays used to recurse over the items, so that
+   dropping a large nested array stopped the interpreter until every
+   block in it had been released, and a deeply nested one could use up
+   the C stack. Instead freeit puts such an array on a queue and
+   freework takes the reference counts of its items down a bounded
+   number at a time, queueing any item that becomes unreferenced and is
+   itself an array of arrays. Each freeit does one portion of the work,
+   so the cost of a large free is spread over the frees that follow it.
+   reserve empties the queue before it expands the heap. Letting go of a
+   phrase or fault changes the atom table, so createatom empties the
+   queue before it chooses a position for a new atom.
+
+   A queued array has its refcnt set to PENDINGTAG. It is still allocated
+   but is passed over by clearheap and cleartemps. The queue is worked
+   depth first, so it only grows with the nesting depth. It is emptied
+   by flushfree before each top level input and where the state of the
+   heap is reported or saved. */
+
+/* routine to add an array of arrays to the free queue */
+
+static void
+queuefree(nialptr x)
+{
+  if (freeqlen == freeqcap) {
+    nialint     newcap = (freeqcap == 0 ? 64 : 2 * freeqcap);
+    struct freeentry *newq =
+    (struct freeentry *) realloc(freeq, newcap * sizeof(struct freeentry));
+
+    if (newq == NULL)
+      exit_cover1("Out of memory for the free queue", NC_FATAL);
+    freeq = newq;
+    freeqcap = newcap;
+  }
+  set_refcnt(x, PENDINGTAG);
+  freeq[freeqlen].arr = x;
+  freeq[freeqlen].next = 0;
+  freeqlen++;
+}
+
+/* routine to reduce the refcnt of an item of an array being freed,
+   freeing it if it is no longer used */
+
+static void
+letgo(nialptr it)
+{
+  if (it != invalidptr &&    /* unused portions of atype arrays */
+      refcnt(it) > 0) {
+    decrrefcnt(it);
+    if (refcnt(it) == 0) {
+      int         k = kind(it);
+
+      if (k == atype)
+        queuefree(it);
+      else {
+        if (k == phrasetype || k == faulttype)
+          remove_atom(it);
+        release(it);
+      }
+    }
+  }
+}
+
+/* routine to do up to budget units of work on the free queue. A budget
+   of -1 empties the queue. */
+
+static void
+freework(nialint budget)
+{
+  while (freeqlen > 0 && budget != 0) {
+    struct freeentry *e = &freeq[freeqlen - 1];
+    nialptr     x = e->arr;
+    nialint     tlx = tally(x);
+
+    if (e->next < tlx) {
+      nialptr     it = *((nialptr *) pfirstitem(x) + e->next);
+
+      e->next++;
+      budget--;
+      letgo(it);             /* may move freeq, e is not used again */
+    }
+    else {                   /* all items let go, release the array */
+      freeqlen--;
+      release(x);
+    }
+  }
+}
+
+/* routine to finish all queued freeing */
+
+void
+flushfree(void)
+{
+  freework(-1);
+}
+
+
 /* routine to clear the heap of temporary arrays on a jump
    to top level. It walks block by block through memory freeing up
    unreferenced arrays ie. arrays with refcnt = 0;
+   It is used after the initial workspace is built and, since it finds
+   every unreferenced array, as a diagnostic through setsweep.
 */
 
 void
@@ -1024,6 +1521,149 @@ clearheap()
     next = next + blksize(next);
   }
   while (next < memsize);
+  marktemps();
+}
+
+
+/* The temporaries log.
+
+   Walking the whole heap on every jump to top level costs time in
+   proportion to the heap, not to the work that was abandoned. Instead
+   reserve records each new block in a log that is emptied each time the
+   top level loop is entered, so that on a jump back only the arrays
+   created since then need to be looked at.
+
+   A logged block holds its position in the log in the spare half of the
+   flags word of its header. release uses it to blank the entry, so every
+   nonzero entry is the start of a live block and the log can be walked
+   without consulting the heap layout. A block whose slot does not point
+   back at it is not in the log. When the log fills, the blank entries are
+   squeezed out and the log is doubled if it is still more than half full.
+
+   A 32 bit header has no spare room, so there the log is not kept and
+   cleartemps falls back to clearheap. It does the same if the log could
+   not be extended or if setsweep has been used to ask for a full
+   sweep. */
+/* routine to add a newly reserved block to the log */
+
+static void
+logtemp(nialptr bx)
+{
+#ifdef INTS64
+  if (templen == tempcap) {
+    nialint     i,
+                j = 0;
+
+    /* squeeze out the entries of released blocks */
+    for (i = 0; i < templen; i++)
+      if (templog[i] != 0) {
+        if (i != j) {
+          templog[j] = templog[i];
+          tmpslot(templog[j]) = (int) j;
+        }
+        j++;
+      }
+    templen = j;
+    if (templen >= tempcap / 2 && !tempsweep) {
+      nialint     newcap = (tempcap == 0 ? TEMPLOGINIT : 2 * tempcap);
+      nialptr    *newlog = NULL;
+
+      if (newcap <= INT_MAX)
+        newlog = (nialptr *) realloc(templog, newcap * sizeof(nialptr));
+      if (newlog == NULL)
+        tempsweep = true;
+      else {
+        templog = newlog;
+        tempcap = newcap;
+      }
+    }
+    if (templen == tempcap) {  /* log is full and could not grow */
+      tmpslot(bx) = -1;
+      return;
+    }
+  }
+  templog[templen] = bx;
+  tmpslot(bx) = (int) templen++;
+#endif
+}
+
+/* routine to remove a block from the log as it is released */
+
+static void
+droptemp(nialptr bx)
+{
+#ifdef INTS64
+  nialint     s = tmpslot(bx);
+
+  if (s >= 0 && s < templen && templog[s] == bx)
+    templog[s] = 0;
+#endif
+}
+
+/* routine to empty the log. It is called at each entry to the top
+   level loop and whenever the heap has been rebuilt. */
+
+void
+marktemps(void)
+{
+#ifdef INTS64
+  templen = 0;
+#endif
+  tempsweep = false;
+}
+
+/* routine to clear the temporary arrays made since the last marktemps
+   on a jump to top level */
+
+void
+cleartemps(void)
+{
+#ifdef INTS64
+  nialint     i;
+
+  if (tempsweep || fullsweep) {
+    clearheap();
+    return;
+  }
+  /* freeup only blanks entries, so templen and the other entries stay put */
+  for (i = 0; i < templen; i++) {
+    nialptr     bx = templog[i];
+
+    if (CSTACKFULL)  {
+      printf("C stack full in cleartemps\n)");
+      tempsweep = true;
+      longjmp(error_env, NC_WARNING);
+    }
+    if (bx != 0 && refcnt(arrayptr(bx)) == 0) {
+      freeup(arrayptr(bx));
+    }
+  }
+  marktemps();
+#else
+  clearheap();
+#endif
+}
+
+/* routine to implement the operation setsweep.
+   setsweep l makes every jump to top level sweep the whole heap for
+   unreferenced arrays, as was done before the temporaries log was kept.
+   setsweep o goes back to clearing only the logged temporaries.
+   The old setting is returned. */
+
+void
+isetsweep(void)
+{
+  nialptr     x = apop();
+  int         old = fullsweep;
+
+  if (!atomic(x) || kind(x) != booltype) {
+    apush(makefault("?setsweep expects a boolean"));
+    freeup(x);
+    return;
+  }
+  fullsweep = boolval(x);
+  apush(createbool(old));
+  freeup(x);
 }
 
 
@@ -1298,11 +1938,15 @@ createatom(unsigned k, char *s)
     posn,
     posn_to_use = 0;
   nialint   dummy;
-  int         match = false, /* indicates that the atom has been found */
-    cont = true,   /* control for loop */
-    hashadjusted = false;
+  int         match, /* indicates that the atom has been found */
+    cont,   /* control for loop */
+    hashadjusted;
 
 
+ probe:                       /* come back here after queued freeing */
+  match = false;
+  cont = true;
+  hashadjusted = false;
   hashv = hash(s);
   posn = hashv;
   while (cont) {
@@ -1334,6 +1978,12 @@ createatom(unsigned k, char *s)
     return z;                /* the atom has been found. Return its array
                               * reference */
 
+  if (freeqlen > 0) {        /* the allocation below must not let go of
+                              * atoms after posn_to_use is chosen */
+    flushfree();
+    goto probe;
+  }
+
   if (!match && hashadjusted && posn == hashv) {  /* The entire atom table
                                                    * was searched and no
                                                    * vacant or held location
@@ -1893,6 +2543,8 @@ istatus(void)
     total,
     cnt;
 
+  flushfree();
+
   /* scan the free list to compute space free, freelist size, and largest
    * available block */
   p = fwdlink(freelisthdr);
@@ -64,6 +64,7 @@ static nialptr gage(nialptr x);
 static void cutorcutall(nialptr x, nialptr y, int cutprim);
 static void nial_solitary(nialptr x);
 static void takedrop(nialptr x, nialptr y, int istake);
+static void takefill(nialptr z, nialint i, nialptr y, nialptr * fillitem, int *fillused);
 static void nseek(nialptr x, nialptr y);
 static void pack(nialptr x);
 static int  validshape(nialptr x);
@@ -74,8 +75,26 @@ static void sfindallatype(nialptr x, nialptr y, int firstonly);
 static void except(nialptr a, nialptr b);
 static void oldexcept(nialptr a, nialptr b);
 static void sexcept(nialptr a, nialptr b);
+static void exceptof(nialptr x, nialptr y);
+static nialptr inmask(nialptr a, nialptr b);
+static nialptr mergeint(nialptr a, nialptr b, int mode);
+static nialptr mergereal(nialptr a, nialptr b, int mode);
+
+/* modes for mergeint and mergereal */
+#define EXCEPTMODE 0
+#define INTERMODE 1
+#define MASKMODE 2
 static void fuse(nialptr a, nialptr b);
+static void movetiles(nialptr z, nialint zo, nialint zi, nialint zj,
+             nialptr b, nialint bo, nialint bi, nialint bj,
+                      nialint ni, nialint nj);
+static void permuteaxes(nialptr result, nialptr b, nialptr a, nialptr ns,
+                        nialptr newstrides);
 static void scull(nialptr a, int diversesw);
+static int  sameitems(nialptr a, int ka, nialint i, nialint j);
+static nialptr groupids(nialptr a, nialptr * keys);
+static void groupby(int mode, char *errmsg);
+static void groupbypair(int mode, char *pairmsg, char *errmsg);
 
 /* global variables used to turn on debugging selectively */
 extern int doprintf;
@@ -1207,6 +1226,8 @@ idrop()
    or the fault ?fill if the kind is atype.
    For drop: the corresponding take ranges are found and the code merged.
    An over drop result in an empty.
+   The items along the last axis that lie within y are moved as one run
+   using copy, so only the fill positions are stored one at a time.
 */
 
 static void
@@ -1217,7 +1238,8 @@ takedrop(nialptr x, nialptr y, int istake)
   int         fillused = false;
   nialint     i,
               j,
-              index,
+              lo,
+              hi,
               tz,
               ty,
               tx = tally(x);
@@ -1351,31 +1373,17 @@ takedrop(nialptr x, nialptr y, int istake)
     z = new_create_array(ky, 1, 0, &length);
     tz = tally(z);
 
-    /* fill in the result */
-    for (i = 0; i < tz; i++) {
-      index = start + i;
-      if (index >= 0 && index < ty) {
-        copy1(z, i, y, index);
-      }
-      else {
-        if (!fillused) {
-          if (ty > 0) {      /* fill with type of first item */
-            apush(fetchasarray(y, 0));
-            itype();
-            fillitem = apop();
-          }
-          else               /* fill with faults. Container will be atype */
-            fillitem = makefault("?fill");
-          fillused = true;
-        }
-        if (kind(z) == atype) {
-          store_array(z, i, fillitem);
-        }
-        else                 /* fillitem is an atom of the same homogeneous
-                              * type as z */
-          copy1(z, i, fillitem, 0);
-      }
-    }
+    /* positions lo to hi-1 of the result come from y */
+    lo = (start < 0 ? -start : 0);
+    hi = (ty - start < tz ? ty - start : tz);
+    if (hi < lo)
+      hi = lo;
+    if (hi > lo)
+      copy(z, lo, y, start + lo, hi - lo);
+    for (i = 0; i < lo; i++)
+      takefill(z, i, y, &fillitem, &fillused);
+    for (i = hi; i < tz; i++)
+      takefill(z, i, y, &fillitem, &fillused);
   }
   else {
     /* set up starts and lengths for each dimension in the result */
@@ -1472,77 +1480,66 @@ takedrop(nialptr x, nialptr y, int istake)
         usefill = true;
     }
 
-    /* loop to walk over indices of the result selecting from y using an
-     * offset based on starts and shape of y. */
-    for (i = 0; i < tz; i++) {  /* compute the index for the item of y and
-                                 * move it to the result */
-      /* check that addr is in bounds on last axis of y */
-      lastdimaddr = fetch_int(addr, lastdim);
-      if (!usefill && lastdimaddr >= 0 && lastdimaddr < bound) {
-        index = offset + pos;
-        copy1(z, i, y, index);
+    /* positions lo to hi-1 of each sweep of the last axis of the result
+       are within the last axis of y */
+    lastdimaddr = fetch_int(starts, lastdim);
+    lo = (lastdimaddr < 0 ? -lastdimaddr : 0);
+    hi = (bound - lastdimaddr < limit ? bound - lastdimaddr : limit);
+    if (hi < lo)
+      hi = lo;
+
+    /* loop to walk over the sweeps of the last axis of the result selecting
+     * from y using an offset based on starts and shape of y. */
+    for (i = 0; i < tz; i += limit) {
+      if (usefill) {
+        for (pos = 0; pos < limit; pos++)
+          takefill(z, i + pos, y, &fillitem, &fillused);
       }
-      else {                 /* do a fill */
-        if (!fillused) {
-          if (ty > 0) {      /* fill with type of first item */
-            apush(fetchasarray(y, 0));
-            itype();
-            fillitem = apop();
-          }
-          else               /* fill with faults. Container will be atype */
-            fillitem = makefault("?fill");
-          fillused = true;
-        }
-        if (kind(z) == atype) {
-          store_array(z, i, fillitem);
-        }
-        else                 /* fillitem is an atom of the same homogeneous
-                              * type as z */
-          copy1(z, i, fillitem, 0);
+      else {
+        if (hi > lo)
+          copy(z, i + lo, y, offset + lo, hi - lo);
+        for (pos = 0; pos < lo; pos++)
+          takefill(z, i + pos, y, &fillitem, &fillused);
+        for (pos = hi; pos < limit; pos++)
+          takefill(z, i + pos, y, &fillitem, &fillused);
       }
 
-      /* increment pos and last dim of addr */
-      pos++;
-      store_int(addr, lastdim, 1 + lastdimaddr);
-      if (pos == limit) {    /* loop over final axis of z is completed. do
-                              * the end of axes processing */
-        pos = 0;             /* reset pos and addr to walk last axis again */
-        store_int(addr, lastdim, fetch_int(starts, lastdim));
-        processaxes = true;
-        dim = tx - 2;        /* other axes are incremented and checked */
-        while (processaxes && dim >= 0) { /* increment the address in the
-                                           * current dimension */
-          store_int(addr, dim, 1 + fetch_int(addr, dim));
-          if (fetch_int(addr, dim) == fetch_int(starts, dim) + fetch_int(lengths, dim)) {
-            store_int(addr, dim, fetch_int(starts, dim)); /* reset dim address
-                                                           * position */
-            /* compute the new offset */
-            offset = 0;
-            for (j = 0; j < tx; j++)
-              offset = offset * pickshape(y, j) + fetch_int(addr, j);
-
-
-            dim--;           /* stay in the while loop to set the next lower
-                              * axis */
-          }
-          else {
-            processaxes = false;
-            offset += fetch_int(strides, dim);  /* increment the offset */
-          }
+      /* the sweep of the final axis of z is
+         completed. do the end of axes processing */
+      processaxes = true;
+      dim = tx - 2;        /* other axes are incremented and checked */
+      while (processaxes && dim >= 0) { /* increment the address in the
+                                         * current dimension */
+        store_int(addr, dim, 1 + fetch_int(addr, dim));
+        if (fetch_int(addr, dim) == fetch_int(starts, dim) + fetch_int(lengths, dim)) {
+          store_int(addr, dim, fetch_int(starts, dim)); /* reset dim address
+                                                         * position */
+          /* compute the new offset */
+          offset = 0;
+          for (j = 0; j < tx; j++)
+            offset = offset * pickshape(y, j) + fetch_int(addr, j);
+
+
+          dim--;           /* stay in the while loop to set the next lower
+                            * axis */
         }
-        /* recompute the usefill flag */
-        usefill = false;
-        for (j = 0; j < lastdim; j++) {
-          nialint     jthaddr = fetch_int(addr, j);
-
-          if (jthaddr < 0 || jthaddr >= pickshape(y, j))
-            usefill = true;
+        else {
+          processaxes = false;
+          offset += fetch_int(strides, dim);  /* increment the offset */
         }
+      }
+      /* recompute the usefill flag */
+      usefill = false;
+      for (j = 0; j < lastdim; j++) {
+        nialint     jthaddr = fetch_int(addr, j);
+
+        if (jthaddr < 0 || jthaddr >= pickshape(y, j))
+          usefill = true;
+      }
 
 #ifdef USER_BREAK_FLAG
-        checksignal(NC_CS_NORMAL);
+      checksignal(NC_CS_NORMAL);
 #endif
-      }
     }
     freeup(starts);
     freeup(lengths);
@@ -1551,6 +1548,8 @@ takedrop(nialptr x, nialptr y, int istake)
   }
   if (homotest(z))
     z = implode(z);          /* in case selection reduces to homo */
+  if (vy == 1 && !fillused && is_sorted(y))
+    set_sorted(z, true);     /* a segment of a sorted list is sorted */
   apush(z);
   freeup(x);
   freeup(y);
@@ -1559,6 +1558,31 @@ takedrop(nialptr x, nialptr y, int istake)
 }
 
 
+/* routine to store the fill item for take at position i of z.
+   The fill item is made on first use. */
+
+static void
+takefill(nialptr z, nialint i, nialptr y, nialptr * fillitem, int *fillused)
+{
+  if (!*fillused) {
+    if (tally(y) > 0) {      /* fill with type of first item */
+      apush(fetchasarray(y, 0));
+      itype();
+      *fillitem = apop();
+    }
+    else                     /* fill with faults. Container will be atype */
+      *fillitem = makefault("?fill");
+    *fillused = true;
+  }
+  if (kind(z) == atype) {
+    store_array(z, i, *fillitem);
+  }
+  else                       /* fillitem is an atom of the same homogeneous
+                              * type as z */
+    copy1(z, i, *fillitem, 0);
+}
+
+
 /* utility routine to convert an integer index into a Nial address, given a ptr to the
    shape and the valence of the array that the address is for.  
    Used in atops.c and trs.c.
@@ -2696,6 +2720,25 @@ sfindallreal(nialptr x, nialptr y, int firstonly)
   freeup(y);
 }
 
+/* up and equal on items of a sorted list during a binary search. Strings
+   are compared directly; anything else goes to up and equal. */
+
+static int
+itemup(nialptr a, nialptr b)
+{
+  int         res = stringup(a, b);
+
+  return (res >= 0 ? res : up(a, b));
+}
+
+static int
+itemequal(nialptr a, nialptr b)
+{
+  int         res = stringequal(a, b);
+
+  return (res >= 0 ? res : equal(a, b));
+}
+
 static void
 sfindallatype(nialptr x, nialptr y, int firstonly)
 {
@@ -2718,8 +2761,8 @@ sfindallatype(nialptr x, nialptr y, int firstonly)
   highdone = firstonly;
   while (!lowdone) {
     /* ensure the target is in the intervals */
-    if (up(target, fetch_array(y, low)) &&
-        !equal(target, fetch_array(y, low))) {
+    if (itemup(target, fetch_array(y, low)) &&
+        !itemequal(target, fetch_array(y, low))) {
       lowdone = true;
       highdone = true;
       low = high + 1;        /* to force Null result */
@@ -2730,11 +2773,11 @@ sfindallatype(nialptr x, nialptr y, int firstonly)
       nialint     lowprobe = (low + midlow) / 2;
       nialptr     lowprobeval = fetch_array(y, lowprobe);
 
-      if (equal(lowprobeval, target)) {
+      if (itemequal(lowprobeval, target)) {
         midlow = lowprobe;
         lowdone = low == lowprobe;  /* test if low boundary found */
       }
-      else if (up(lowprobeval, target)) { /* increase low */
+      else if (itemup(lowprobeval, target)) { /* increase low */
         low = lowprobe + 1;
         lowdone = low > ty - 1;
       }
@@ -2752,7 +2795,7 @@ sfindallatype(nialptr x, nialptr y, int firstonly)
     nialptr     yhigh = fetch_array(y, high);
 
     /* ensure the target is in the intervals */
-    if (up(yhigh, target) && !equal(yhigh, target)) {
+    if (itemup(yhigh, target) && !itemequal(yhigh, target)) {
       highdone = true;
       low = high + 1;        /* to force Null result */
     }
@@ -2762,11 +2805,11 @@ sfindallatype(nialptr x, nialptr y, int firstonly)
       nialint     highprobe = (high + midhigh + 1) / 2;
       nialptr     highprobeval = fetch_array(y, highprobe);
 
-      if (equal(highprobeval, target)) {
+      if (itemequal(highprobeval, target)) {
         midhigh = highprobe;
         highdone = high == highprobe;
       }
-      else if (!up(highprobeval, target)) {
+      else if (!itemup(highprobeval, target)) {
         high = highprobe - 1;
         highdone = high < 0;
       }
@@ -3072,6 +3115,14 @@ b_except(void)
   nialptr     y = apop(),
               x = apop();
 
+  exceptof(x, y);
+}
+
+/* routine to choose the except algorithm for x and y */
+
+static void
+exceptof(nialptr x, nialptr y)
+{
   if (!(is_sorted(x) || check_sorted(x))) {
     if (tally(x) == 1 || (tally(x) * tally(y) <= CROSSOVER))
       oldexcept(x, y);
@@ -3137,19 +3188,7 @@ iexcept(void)
   }
   else {
     splitfb(z, &x, &y);
-    if (!(is_sorted(x) || check_sorted(x))) {
-      if (tally(x) == 1 || (tally(x) * tally(y) <= CROSSOVER))
-        oldexcept(x, y);
-      else
-        except(x, y);
-    }
-    else {
-      if (!(is_sorted(y) || check_sorted(y))) {
-        sort(upcode, y, false);
-        y = apop();
-      }
-      sexcept(x, y);
-    }
+    exceptof(x, y);
   }
   freeup(z);
 }
@@ -3402,6 +3441,14 @@ sexcept(nialptr a, nialptr b)
   /* ensure a and b are of the same homotype or are atype */
   ka = kind(a);
   kb = kind(b);
+  if (ka == kb && (ka == inttype || ka == realtype)) {
+    z = (ka == inttype ? mergeint(a, b, EXCEPTMODE) : mergereal(a, b, EXCEPTMODE));
+    set_sorted(z, true);     /* since a was sorted */
+    apush(z);
+    freeup(a);
+    freeup(b);
+    return;
+  }
   if (ka != kb) {
     if (homotype(ka)) {
       a = explode(a, 1, ta, 0, ta);
@@ -3554,6 +3601,861 @@ sexcept(nialptr a, nialptr b)
   freeup(b);
 }
 
+/* Merge kernels for two sorted lists of integers or of reals.
+
+   mergeint and mergereal walk the lists a and b together. Where the
+   items of one list fall behind those of the other, the gap is closed by
+   galloping: the step is doubled until the value being caught up to is
+   passed and a binary search then finds its place. A run of items of a
+   that are not in b is found in time logarithmic in its length, and the
+   items of b that a passes over cost almost nothing, so a short list is
+   matched against a long one in time close to that of the short one.
+   The mode selects the result:
+     EXCEPTMODE the list of items of a that are not in b,
+     INTERMODE  the list of items of a that are in b,
+     MASKMODE   the boolean list marking the items of a that are in b.
+   The arguments are not freed.
+*/
+
+/* routines to find the first position after lo in p[0..n-1] holding a
+   value that is not below v, given that p[lo] < v */
+
+static      nialint
+gallopint(nialint * p, nialint lo, nialint n, nialint v)
+{
+  nialint     step = 1,
+              hi = lo + 1,
+              mid;
+
+  while (hi < n && p[hi] < v) {
+    lo = hi;
+    step *= 2;
+    hi = lo + step;
+  }
+  if (hi > n)
+    hi = n;
+  while (hi - lo > 1) {      /* p[lo] < v, and p[hi] >= v or hi = n */
+    mid = lo + (hi - lo) / 2;
+    if (p[mid] < v)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return hi;
+}
+
+static      nialint
+gallopreal(double *p, nialint lo, nialint n, double v)
+{
+  nialint     step = 1,
+              hi = lo + 1,
+              mid;
+
+  while (hi < n && p[hi] < v) {
+    lo = hi;
+    step *= 2;
+    hi = lo + step;
+  }
+  if (hi > n)
+    hi = n;
+  while (hi - lo > 1) {
+    mid = lo + (hi - lo) / 2;
+    if (p[mid] < v)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return hi;
+}
+
+/* routine to move the first cnt items of the list z of kind k to a
+   container of the right size */
+
+static      nialptr
+trimlist(nialptr z, nialint cnt, int k)
+{
+  nialptr     res;
+
+  if (cnt == tally(z))
+    return z;
+  if (cnt == 0)
+    res = Null;
+  else {
+    res = new_create_array(k, 1, 0, &cnt);
+    copy(res, 0, z, 0, cnt);
+  }
+  freeup(z);
+  return res;
+}
+
+static      nialptr
+mergeint(nialptr a, nialptr b, int mode)
+{
+  nialint     ta = tally(a),
+              tb = tally(b),
+              i = 0,
+              j = 0,
+              k,
+              cnt = 0;
+  nialptr     z = new_create_array(mode == MASKMODE ? booltype : inttype, 1, 0, &ta);
+  nialint    *pa = pfirstint(a),  /* safe: allocation done */
+             *pb = pfirstint(b),
+             *pz = pfirstint(z);
+
+  while (i < ta && j < tb) {
+    if (pa[i] < pb[j]) {     /* a run of items not in b */
+      k = gallopint(pa, i, ta, pb[j]);
+      if (mode == EXCEPTMODE) {
+        memcpy(pz + cnt, pa + i, (k - i) * sizeof(nialint));
+        cnt += k - i;
+      }
+      i = k;
+    }
+    else if (pa[i] > pb[j])
+      j = gallopint(pb, j, tb, pa[i]);
+    else {                   /* keep j for repeated items of a */
+      if (mode == INTERMODE)
+        pz[cnt++] = pa[i];
+      else if (mode == MASKMODE)
+        store_bool(z, i, true);
+      i++;
+    }
+  }
+  if (mode == EXCEPTMODE && i < ta) {
+    memcpy(pz + cnt, pa + i, (ta - i) * sizeof(nialint));
+    cnt += ta - i;
+  }
+  return (mode == MASKMODE ? z : trimlist(z, cnt, inttype));
+}
+
+static      nialptr
+mergereal(nialptr a, nialptr b, int mode)
+{
+  nialint     ta = tally(a),
+              tb = tally(b),
+              i = 0,
+              j = 0,
+              k,
+              cnt = 0;
+  nialptr     z = new_create_array(mode == MASKMODE ? booltype : realtype, 1, 0, &ta);
+  double     *pa = pfirstreal(a),  /* safe: allocation done */
+             *pb = pfirstreal(b),
+             *pz = pfirstreal(z);
+
+  while (i < ta && j < tb) {
+    if (pa[i] < pb[j]) {
+      k = gallopreal(pa, i, ta, pb[j]);
+      if (mode == EXCEPTMODE) {
+        memcpy(pz + cnt, pa + i, (k - i) * sizeof(double));
+        cnt += k - i;
+      }
+      i = k;
+    }
+    else if (pa[i] > pb[j])
+      j = gallopreal(pb, j, tb, pa[i]);
+    else if (pa[i] == pb[j]) {
+      if (mode == INTERMODE)
+        pz[cnt++] = pa[i];
+      else if (mode == MASKMODE)
+        store_bool(z, i, true);
+      i++;
+    }
+    else {                   /* a NaN, which is in no list */
+      if (mode == EXCEPTMODE)
+        pz[cnt++] = pa[i];
+      i++;
+    }
+  }
+  if (mode == EXCEPTMODE && i < ta) {
+    memcpy(pz + cnt, pa + i, (ta - i) * sizeof(double));
+    cnt += ta - i;
+  }
+  return (mode == MASKMODE ? z : trimlist(z, cnt, realtype));
+}
+
+
+/* The routines below implement the operations inmask, inter and union.
+
+   A inmask B is the boolean array of the shape of A marking the items of
+   A that are in B, the same as A EACHLEFT in B. B is sorted if it is not flagged as
+   sorted already. Lists of integers or reals that are both sorted use
+   the merge kernel. Otherwise each item of A is found by a binary search
+   in B, or by a table lookup if both are strings or boolean lists.
+
+   A inter B is the list of items of A that are in B, computed by the
+   merge kernel or as A inmask B sublist A. A union B is the list of the items of A followed
+   by the items of B that are not in A, computed as A link (B except A).
+   inter keeps the order of A, so its result is flagged as sorted if A is.
+*/
+
+static      nialptr
+inmask(nialptr a, nialptr b)
+{
+  nialptr     z;
+  nialint     i,
+              ta,
+              tb;
+  int         ka,
+              kb;
+
+  if (atomic(b)) {
+    apush(b);
+    ilist();
+    b = apop();
+  }
+  if (!(is_sorted(b) || check_sorted(b))) {
+    sort(upcode, b, false);
+    b = apop();
+  }
+  ta = tally(a);
+  tb = tally(b);
+  ka = kind(a);
+  kb = kind(b);
+  if (ta == 0) {
+    freeup(b);
+    return Null;
+  }
+  if (ka == kb && (ka == inttype || ka == realtype) && valence(a) == 1 &&
+      (is_sorted(a) || check_sorted(a))) {
+    z = (ka == inttype ? mergeint(a, b, MASKMODE) : mergereal(a, b, MASKMODE));
+    freeup(b);
+    return z;
+  }
+
+  z = new_create_array(booltype, 1, 0, &ta);
+  if (tb == 0) {
+    freeup(b);
+    return z;
+  }
+  if (ka == kb && ka == inttype) {
+    nialint    *pa = pfirstint(a),  /* safe: allocation done */
+               *pb = pfirstint(b);
+
+    for (i = 0; i < ta; i++) {
+      nialint     v = pa[i],
+                  k = (pb[0] < v ? gallopint(pb, 0, tb, v) : 0);
+
+      if (k < tb && pb[k] == v)
+        store_bool(z, i, true);
+    }
+  }
+  else if (ka == kb && ka == realtype) {
+    double     *pa = pfirstreal(a),  /* safe: allocation done */
+               *pb = pfirstreal(b);
+
+    for (i = 0; i < ta; i++) {
+      double      v = pa[i];
+      nialint     k = (pb[0] < v ? gallopreal(pb, 0, tb, v) : 0);
+
+      if (k < tb && pb[k] == v)
+        store_bool(z, i, true);
+    }
+  }
+  else if (ka == kb && (ka == chartype || ka == booltype)) {
+    char        seen[HIGHCHAR - LOWCHAR + 1];
+
+    memset(seen, 0, sizeof seen);
+    if (ka == chartype) {
+      for (i = 0; i < tb; i++)
+        seen[fetch_char(b, i) - LOWCHAR] = 1;
+      for (i = 0; i < ta; i++)
+        if (seen[fetch_char(a, i) - LOWCHAR])
+          store_bool(z, i, true);
+    }
+    else {
+      for (i = 0; i < tb; i++)
+        seen[fetch_bool(b, i)] = 1;
+      for (i = 0; i < ta; i++)
+        if (seen[fetch_bool(a, i)])
+          store_bool(z, i, true);
+    }
+  }
+  else {                     /* binary search on the items of b */
+    if (homotype(kb))
+      b = explode(b, 1, tb, 0, tb);
+    apush(b);                /* protect b */
+    for (i = 0; i < ta; i++) {
+      nialptr     x = fetchasarray(a, i);
+      nialint     lo = 0,
+                  hi = tb,
+                  mid;
+      int         found = false;
+
+      apush(x);              /* protect x in up and equal */
+      while (lo < hi) {      /* first item of b that is not below x */
+        mid = lo + (hi - lo) / 2;
+        if (itemup(x, fetch_array(b, mid)))
+          hi = mid;
+        else
+          lo = mid + 1;
+      }
+      /* items that up ranks with x need not equal it, as with 1 and 1. */
+      while (!found && lo < tb && itemup(fetch_array(b, lo), x)) {
+        found = itemequal(x, fetch_array(b, lo));
+        lo++;
+      }
+      if (found)
+        store_bool(z, i, true);
+      freeup(apop());
+    }
+    freeup(apop());          /* unprotect b */
+    return z;
+  }
+  freeup(b);
+  return z;
+}
+
+void
+b_inmask(void)
+{
+  nialptr     y = apop(),
+              x = apop(),
+              m;
+  int         v = valence(x);
+
+  if (atomic(x)) {
+    apush(x);
+    ilist();
+    x = apop();
+  }
+  apush(x);                  /* protect x */
+  m = inmask(x, y);
+  if (v != 1) {              /* give the result the shape of A */
+    nialptr     z;
+    nialint     i,
+                t = tally(m);
+
+    if (v == 0)
+      z = createbool(fetch_bool(m, 0));
+    else {
+      z = new_create_array(booltype, v, 0, shpptr(x, v));
+      for (i = 0; i < t; i++)
+        store_bool(z, i, fetch_bool(m, i));
+    }
+    freeup(m);
+    m = z;
+  }
+  freeup(apop());            /* unprotect x */
+  apush(m);
+}
+
+void
+iinmask(void)
+{
+  nialptr     z,
+              x,
+              y;
+
+  if (kind(top) == faulttype && top != Nullexpr &&
+      top != Eoffault && top != Zenith && top != Nadir)
+    return;
+  z = apop();
+  if (tally(z) != 2) {
+    apush(makefault("?argument of inmask must be a pair"));
+  }
+  else {
+    splitfb(z, &x, &y);
+    apush(x);
+    apush(y);
+    b_inmask();
+  }
+  freeup(z);
+}
+
+void
+b_inter(void)
+{
+  nialptr     y = apop(),
+              x = apop(),
+              m;
+
+  if (atomic(x)) {
+    apush(x);
+    ilist();
+    x = apop();
+  }
+  if (kind(x) == kind(y) && (kind(x) == inttype || kind(x) == realtype) &&
+      valence(y) == 1 && (is_sorted(x) || check_sorted(x)) &&
+      (is_sorted(y) || check_sorted(y))) {
+    m = (kind(x) == inttype ? mergeint(x, y, INTERMODE) : mergereal(x, y, INTERMODE));
+    set_sorted(m, true);     /* since x was sorted */
+    apush(m);
+    freeup(x);
+    freeup(y);
+    return;
+  }
+  apush(x);                  /* protect x */
+  m = inmask(x, y);
+  x = apop();
+  sublist(m, x);             /* cleans up m and x and does set_sorted */
+}
+
+void
+iinter(void)
+{
+  nialptr     z,
+              x,
+              y;
+
+  if (kind(top) == faulttype && top != Nullexpr &&
+      top != Eoffault && top != Zenith && top != Nadir)
+    return;
+  z = apop();
+  if (tally(z) != 2) {
+    apush(makefault("?argument of inter must be a pair"));
+  }
+  else {
+    splitfb(z, &x, &y);
+    apush(x);
+    apush(y);
+    b_inter();
+  }
+  freeup(z);
+}
+
+void
+b_union(void)
+{
+  nialptr     y = apop(),
+              x = apop(),
+              r;
+
+  apush(x);                  /* protect x */
+  exceptof(y, x);
+  r = apop();
+  x = apop();
+  pair(x, r);
+  ilink();
+}
+
+void
+iunion(void)
+{
+  nialptr     z,
+              x,
+              y;
+
+  if (kind(top) == faulttype && top != Nullexpr &&
+      top != Eoffault && top != Zenith && top != Nadir)
+    return;
+  z = apop();
+  if (tally(z) != 2) {
+    apush(makefault("?argument of union must be a pair"));
+  }
+  else {
+    splitfb(z, &x, &y);
+    apush(x);
+    apush(y);
+    b_union();
+  }
+  freeup(z);
+}
+
+
+/* routines to implement group and the grouped aggregates.
+
+   group A partitions the items of A into classes of equal items by
+   hashing, rather than by sorting as in BYKEY. The result is the pair
+   formed by the list of distinct keys, in the order they first occur in
+   A, and the list of the addresses of the items of list A in each class.
+   Keys are compared with equal, as in cull, so the first item of the
+   result is always cull A.
+
+   The aggregates groupcount, groupsum, groupmin, groupmax and groupmean
+   make the same partition of A and combine the corresponding items of a
+   numeric list B class by class in one pass, without forming the
+   classes. Each returns the pair formed by the keys and the list of
+   aggregate values.
+*/
+
+/* routine to test items i and j of the list a for equality without
+   creating them */
+
+static int
+sameitems(nialptr a, int ka, nialint i, nialint j)
+{
+  switch (ka) {
+    case booltype:
+        return fetch_bool(a, i) == fetch_bool(a, j);
+    case inttype:
+        return fetch_int(a, i) == fetch_int(a, j);
+    case chartype:
+        return fetch_char(a, i) == fetch_char(a, j);
+    case realtype:
+        return fetch_real(a, i) == fetch_real(a, j);
+    default:
+        return equal(fetch_array(a, i), fetch_array(a, j));
+  }
+}
+
+/* groupids computes the class number of each item of the list a, with
+   the classes numbered in the order they first occur, and returns them
+   as an integer list. The distinct keys are returned in *keys.
+   The hash table is an integer array using open addressing with linear
+   probing. It holds a class number in each used slot and is sized to at
+   least twice the tally so that probe chains stay short. The integer
+   arrays are accessed through fetch_int and store_int since equal may
+   allocate, moving the heap. a is not freed. */
+
+static      nialptr
+groupids(nialptr a, nialptr * keys)
+{
+  nialint     t = tally(a),
+              size = 16,
+              mask,
+              ng = 0,
+              i,
+              h,
+              g;
+  nialptr     ids,
+              firsts,
+              table,
+              z;
+  int         ka = kind(a);
+
+  while (size < 2 * t)
+    size *= 2;
+  mask = size - 1;
+  ids = new_create_array(inttype, 1, 0, &t);
+  firsts = new_create_array(inttype, 1, 0, &t);
+  table = new_create_array(inttype, 1, 0, &size);
+  for (i = 0; i < size; i++)
+    store_int(table, i, -1);
+  for (i = 0; i < t; i++) {
+    h = itemhash(a, i) & mask;
+    while ((g = fetch_int(table, h)) >= 0 &&
+           !sameitems(a, ka, fetch_int(firsts, g), i))
+      h = (h + 1) & mask;
+    if (g < 0) {             /* a new class */
+      g = ng++;
+      store_int(table, h, g);
+      store_int(firsts, g, i);
+    }
+    store_int(ids, i, g);
+  }
+  freeup(table);
+
+  /* select the first item of each class as its key */
+  z = new_create_array(ka, 1, 0, &ng);
+  for (i = 0; i < ng; i++) {
+    copy1(z, i, a, fetch_int(firsts, i));
+  }
+  freeup(firsts);
+  *keys = z;
+  return ids;
+}
+
+/* groupaggregate computes the keys and the aggregate values for the
+   list a and values b. It returns false, leaving the results unset, if b
+   is not a boolean, integer or real list with the tally of a. Booleans
+   are combined as integers. An integer sum that overflows gives the
+   fault ?Integer overflow in its place. It is used by the primitives
+   below and by BYKEY for sum, max and min. The arguments are not freed. */
+
+int
+groupaggregate(nialptr a, nialptr b, int mode, nialptr * keys, nialptr * aggs)
+{
+  nialptr     ids,
+              z,
+              w = Null,
+              ovf = Null;
+  nialint     t = tally(a),
+              ng,
+              i,
+              g,
+              next,
+              v,
+              s;
+  int         kb = kind(b),
+              anyovf = false;
+  double      r;
+
+  if (mode != GROUPCOUNT && (valence(b) != 1 || tally(b) != t ||
+        (kb != booltype && kb != inttype && kb != realtype)))
+    return false;
+  ids = groupids(a, keys);
+  ng = tally(*keys);
+  switch (mode) {
+    case GROUPCOUNT:
+        z = new_create_array(inttype, 1, 0, &ng);
+        for (g = 0; g < ng; g++)
+          store_int(z, g, 0);
+        for (i = 0; i < t; i++) {
+          g = fetch_int(ids, i);
+          store_int(z, g, fetch_int(z, g) + 1);
+        }
+        break;
+    case GROUPSUM:
+        if (kb == realtype) {
+          z = new_create_array(realtype, 1, 0, &ng);
+          for (g = 0; g < ng; g++)
+            store_real(z, g, 0.);
+          for (i = 0; i < t; i++) {
+            g = fetch_int(ids, i);
+            store_real(z, g, fetch_real(z, g) + fetch_real(b, i));
+          }
+          break;
+        }
+        z = new_create_array(inttype, 1, 0, &ng);
+        ovf = new_create_array(booltype, 1, 0, &ng);
+        for (g = 0; g < ng; g++) {
+          store_int(z, g, 0);
+          store_bool(ovf, g, false);
+        }
+        for (i = 0; i < t; i++) {
+          g = fetch_int(ids, i);
+          v = (kb == inttype ? fetch_int(b, i) : fetch_bool(b, i));
+          s = (nialint) ((unialint) fetch_int(z, g) + (unialint) v);
+          if ((v > 0 && s < fetch_int(z, g)) || (v < 0 && s > fetch_int(z, g))) {
+            store_bool(ovf, g, true);
+            anyovf = true;
+          }
+          else
+            store_int(z, g, s);
+        }
+        break;
+    case GROUPMIN:
+    case GROUPMAX:
+        /* classes are numbered in order of first occurrence, so the first
+           item of class g is the one met when next reaches g */
+        next = 0;
+        if (kb == realtype) {
+          z = new_create_array(realtype, 1, 0, &ng);
+          for (i = 0; i < t; i++) {
+            g = fetch_int(ids, i);
+            r = fetch_real(b, i);
+            if (g == next) {
+              store_real(z, g, r);
+              next++;
+            }
+            else if (mode == GROUPMIN ? r < fetch_real(z, g) : r > fetch_real(z, g))
+              store_real(z, g, r);
+          }
+          break;
+        }
+        z = new_create_array(inttype, 1, 0, &ng);
+        for (i = 0; i < t; i++) {
+          g = fetch_int(ids, i);
+          v = (kb == inttype ? fetch_int(b, i) : fetch_bool(b, i));
+          if (g == next) {
+            store_int(z, g, v);
+            next++;
+          }
+          else if (mode == GROUPMIN ? v < fetch_int(z, g) : v > fetch_int(z, g))
+            store_int(z, g, v);
+        }
+        break;
+    case GROUPMEAN:
+    default:
+        z = new_create_array(realtype, 1, 0, &ng);
+        w = new_create_array(inttype, 1, 0, &ng);
+        for (g = 0; g < ng; g++) {
+          store_real(z, g, 0.);
+          store_int(w, g, 0);
+        }
+        for (i = 0; i < t; i++) {
+          g = fetch_int(ids, i);
+          r = (kb == realtype ? fetch_real(b, i) :
+               kb == inttype ? (double) fetch_int(b, i) : (double) fetch_bool(b, i));
+          store_real(z, g, fetch_real(z, g) + r);
+          store_int(w, g, fetch_int(w, g) + 1);
+        }
+        for (g = 0; g < ng; g++)
+          store_real(z, g, fetch_real(z, g) / fetch_int(w, g));
+        freeup(w);
+        break;
+  }
+  if (anyovf) {              /* replace the overflowed sums by faults */
+    nialptr     zz = new_create_array(atype, 1, 0, &ng);
+
+    for (g = 0; g < ng; g++) {
+      if (fetch_bool(ovf, g)) {
+        store_array(zz, g, makefault("?Integer overflow"));
+      }
+      else {
+        store_array(zz, g, createint(fetch_int(z, g)));
+      }
+    }
+    freeup(z);
+    z = zz;
+  }
+  freeup(ovf);
+  freeup(ids);
+  *aggs = z;
+  return true;
+}
+
+void
+igroup(void)
+{
+  nialptr     a,
+              ids,
+              keys,
+              z,
+              it;
+  nialint     t,
+              ng,
+              i,
+              g,
+              cnt;
+
+  ilist();
+  a = apop();
+  t = tally(a);
+  ids = groupids(a, &keys);
+  ng = tally(keys);
+
+  /* count the items in each class and create the address lists */
+  z = new_create_array(atype, 1, 0, &ng);
+  {
+    nialptr     counts = new_create_array(inttype, 1, 0, &ng);
+
+    for (g = 0; g < ng; g++)
+      store_int(counts, g, 0);
+    for (i = 0; i < t; i++) {
+      g = fetch_int(ids, i);
+      store_int(counts, g, fetch_int(counts, g) + 1);
+    }
+    for (g = 0; g < ng; g++) {
+      cnt = fetch_int(counts, g);
+      it = new_create_array(inttype, 1, 0, &cnt);
+      store_array(z, g, it);
+      store_int(counts, g, 0);  /* reused as the fill position */
+    }
+    for (i = 0; i < t; i++) {
+      g = fetch_int(ids, i);
+      cnt = fetch_int(counts, g);
+      store_int(fetch_array(z, g), cnt, i);
+      store_int(counts, g, cnt + 1);
+    }
+    freeup(counts);
+  }
+  for (g = 0; g < ng; g++)
+    set_sorted(fetch_array(z, g), true);
+  freeup(ids);
+  freeup(a);
+  pair(keys, z);
+}
+
+void
+igroupcount(void)
+{
+  nialptr     a,
+              keys,
+              z;
+
+  ilist();
+  a = apop();
+  groupaggregate(a, a, GROUPCOUNT, &keys, &z);
+  freeup(a);
+  pair(keys, z);
+}
+
+/* routine shared by the binary grouped aggregates */
+
+static void
+groupby(int mode, char *errmsg)
+{
+  nialptr     y = apop(),
+              x = apop(),
+              keys,
+              z;
+
+  apush(y);                  /* protect y */
+  apush(x);
+  ilist();
+  x = apop();
+  y = apop();
+  if (groupaggregate(x, y, mode, &keys, &z)) {
+    freeup(x);
+    freeup(y);
+    pair(keys, z);
+  }
+  else {
+    freeup(x);
+    freeup(y);
+    apush(makefault(errmsg));
+  }
+}
+
+/* routine shared by the unary forms of the binary grouped aggregates */
+
+static void
+groupbypair(int mode, char *pairmsg, char *errmsg)
+{
+  nialptr     z,
+              x,
+              y;
+
+  if (kind(top) == faulttype && top != Nullexpr &&
+      top != Eoffault && top != Zenith && top != Nadir)
+    return;
+  z = apop();
+  if (tally(z) != 2) {
+    apush(makefault(pairmsg));
+  }
+  else {
+    splitfb(z, &x, &y);
+    apush(x);
+    apush(y);
+    groupby(mode, errmsg);
+  }
+  freeup(z);
+}
+
+void
+b_groupsum(void)
+{
+  groupby(GROUPSUM, "?values of groupsum must be a numeric list matching the keys");
+}
+
+void
+igroupsum(void)
+{
+  groupbypair(GROUPSUM, "?argument of groupsum must be a pair",
+              "?values of groupsum must be a numeric list matching the keys");
+}
+
+void
+b_groupmin(void)
+{
+  groupby(GROUPMIN, "?values of groupmin must be a numeric list matching the keys");
+}
+
+void
+igroupmin(void)
+{
+  groupbypair(GROUPMIN, "?argument of groupmin must be a pair",
+              "?values of groupmin must be a numeric list matching the keys");
+}
+
+void
+b_groupmax(void)
+{
+  groupby(GROUPMAX, "?values of groupmax must be a numeric list matching the keys");
+}
+
+void
+igroupmax(void)
+{
+  groupbypair(GROUPMAX, "?argument of groupmax must be a pair",
+              "?values of groupmax must be a numeric list matching the keys");
+}
+
+void
+b_groupmean(void)
+{
+  groupby(GROUPMEAN, "?values of groupmean must be a numeric list matching the keys");
+}
+
+void
+igroupmean(void)
+{
+  groupbypair(GROUPMEAN, "?argument of groupmean must be a pair",
+              "?values of groupmean must be a numeric list matching the keys");
+}
+
+
 /* We use the old code when the args are small */
 
 static void
@@ -3865,6 +4767,7 @@ ifuse(void)
     the permutation to select the corresponding addresses of b.
     This computation is done by computing the strides of b associated
     with the axes of the result according to the permutation vector.
+    When no axes are fused the items are moved by permuteaxes.
 */
 
 static void
@@ -4051,6 +4954,16 @@ fuse(nialptr a, nialptr b)
         }
       }
 
+      if (ka == inttype) {   /* a permutation of the axes */
+        permuteaxes(result, b, a, ns, newstrides);
+        freeup(strides);
+        freeup(newstrides);
+        freeup(toaddr);
+        apush(result);
+        freeup(ns);
+        goto cleanup;
+      }
+
       /* the stride is based on the last axis */
       stride = fetch_int(newstrides, ta - 1);
       limit = fetch_int(ns, ta - 1);
@@ -4102,11 +5015,151 @@ cleanup:
 
 }
 
+/* movetiles moves an ni by nj block of items of b to z, where item (i,j)
+   of the block is at zo+i*zi+j*zj in z and at bo+i*bi+j*bj in b. The
+   block is walked in TBLOCK square tiles so that each tile touches only a
+   few cache lines and pages of both arrays, even when one of them is read
+   or written down a long stride as in a transpose. The inner loops work
+   on raw pointers, which lets the compiler vectorize them. Booleans are
+   tiled on whole words of bits. No heap allocation is done. */
+
+#define TBLOCK 32
+
+#define TILELOOP(tb, move) \
+  for (i0 = 0; i0 < ni; i0 += tb) { \
+    nialint ie = (i0 + tb < ni ? i0 + tb : ni); \
+    for (j0 = 0; j0 < nj; j0 += tb) { \
+      nialint je = (j0 + tb < nj ? j0 + tb : nj); \
+      for (i = i0; i < ie; i++) \
+        for (j = j0; j < je; j++) \
+          move; \
+    } \
+  }
+
+static void
+movetiles(nialptr z, nialint zo, nialint zi, nialint zj,
+          nialptr b, nialint bo, nialint bi, nialint bj,
+          nialint ni, nialint nj)
+{
+  nialint     i0,
+              j0,
+              i,
+              j;
+
+  switch (kind(b)) {
+    case inttype:
+        {
+          nialint    *zp = pfirstint(z) + zo,
+                     *bp = pfirstint(b) + bo;
+
+          TILELOOP(TBLOCK, zp[i * zi + j * zj] = bp[i * bi + j * bj]);
+        }
+        break;
+    case realtype:
+        {
+          double     *zp = pfirstreal(z) + zo,
+                     *bp = pfirstreal(b) + bo;
+
+          TILELOOP(TBLOCK, zp[i * zi + j * zj] = bp[i * bi + j * bj]);
+        }
+        break;
+    case chartype:
+        {
+          char       *zp = pfirstchar(z) + zo,
+                     *bp = pfirstchar(b) + bo;
+
+          TILELOOP(TBLOCK, zp[i * zi + j * zj] = bp[i * bi + j * bj]);
+        }
+        break;
+    case booltype:
+        TILELOOP(boolsPW,
+          store_bool(z, zo + i * zi + j * zj, fetch_bool(b, bo + i * bi + j * bj)));
+        break;
+    case atype:
+        {
+          nialptr    *bp = pfirstitem(b) + bo;
+
+          TILELOOP(TBLOCK, store_array(z, zo + i * zi + j * zj, bp[i * bi + j * bj]));
+        }
+        break;
+  }
+}
+
+/* permuteaxes fills result from b for fuse when the left argument a is a
+   permutation of the axes of b. ns is the shape of the result and
+   newstrides holds the stride in b of each axis of the result. If the
+   last axis of b stays last, each sweep is a run moved with copy.
+   Otherwise, for each address on the remaining axes, the plane formed by
+   the last axis of the result and the axis that came from the last axis
+   of b is moved with movetiles, so both arrays are walked in tiles. */
+
+static void
+permuteaxes(nialptr result, nialptr b, nialptr a, nialptr ns, nialptr newstrides)
+{
+  nialint     ta = tally(ns),
+              last = ta - 1,
+              m = 0,
+              tr = tally(result),
+              zoffset,
+              boffset,
+              zstride,
+              i,
+              k;
+  nialptr     zstrides,
+              toaddr;
+
+  /* m is the axis of the result that came from the last axis of b */
+  for (k = 0; k < ta; k++)
+    if (fetch_int(a, k) == ta - 1)
+      m = k;
+  zstrides = new_create_array(inttype, 1, 0, &ta);
+  toaddr = new_create_array(inttype, 1, 0, &ta);
+  zstride = 1;
+  for (k = last; k >= 0; k--) {
+    store_int(zstrides, k, zstride);
+    zstride *= fetch_int(ns, k);
+    store_int(toaddr, k, 0);
+  }
+
+  /* loop over the addresses of the axes other than m and last */
+  for (i = 0; i < tr; ) {
+    zoffset = 0;
+    boffset = 0;
+    for (k = 0; k < ta; k++) {
+      zoffset += fetch_int(zstrides, k) * fetch_int(toaddr, k);
+      boffset += fetch_int(newstrides, k) * fetch_int(toaddr, k);
+    }
+    if (m == last) {
+      copy(result, zoffset, b, boffset, fetch_int(ns, last));
+      i += fetch_int(ns, last);
+    }
+    else {
+      movetiles(result, zoffset, fetch_int(zstrides, m), 1,
+                b, boffset, 1, fetch_int(newstrides, last),
+                fetch_int(ns, m), fetch_int(ns, last));
+      i += fetch_int(ns, m) * fetch_int(ns, last);
+    }
+    for (k = last - 1; k >= 0; k--) {
+      if (k == m)
+        continue;
+      store_int(toaddr, k, fetch_int(toaddr, k) + 1);
+      if (fetch_int(toaddr, k) < fetch_int(ns, k))
+        break;
+      store_int(toaddr, k, 0);
+    }
+#ifdef USER_BREAK_FLAG
+    checksignal(NC_CS_NORMAL);
+#endif
+  }
+  freeup(zstrides);
+  freeup(toaddr);
+}
+
 /* the routine to implement the Nial primitive transpose.
    It is done directly for a 2-dimensional array (matrix) and
    by the identity
          transpose A = reverse A axes A fuse A
-   if valence A > 2.
+   if valence A > 2. The matrix case is moved in tiles by movetiles.
 */
 
 void
@@ -4123,13 +5176,8 @@ itranspose(void)
     apush(x);
   }
   else if (vx == 2) {
-    nialint     i,
-                j,
-                k,
-                p,
-                r,
+    nialint     r,
                 c,
-                tx = tally(x),
                *shp = shpptr(x, vx),  /* Safe. only used in r and c below */
                 newshp[2];
     nialptr     z;
@@ -4139,91 +5187,8 @@ itranspose(void)
     newshp[0] = c;
     newshp[1] = r;
     z = new_create_array(kind(x), 2, 0, newshp);
-    switch (kind(x)) {
-      case chartype:
-          {
-            char       *xp = pfirstchar(x);
-
-            i = 0;
-            j = 0;
-            for (k = 0; k < tx; k++) {
-              p = j * r + i;
-              store_char(z, p, xp[k]);
-              j++;
-              if (j == c) {
-                i++;
-                j = 0;
-              }
-            }
-            break;
-          }
-      case inttype:
-          {
-            nialint    *xp = pfirstint(x);
-
-            i = 0;
-            j = 0;
-            for (k = 0; k < tx; k++) {
-              p = j * r + i;
-              store_int(z, p, xp[k]);
-              j++;
-              if (j == c) {
-                i++;
-                j = 0;
-              }
-            }
-            break;
-          }
-      case realtype:
-          {
-            double     *xp = pfirstreal(x);
-
-            i = 0;
-            j = 0;
-            for (k = 0; k < tx; k++) {
-              p = j * r + i;
-              store_real(z, p, xp[k]);
-              j++;
-              if (j == c) {
-                i++;
-                j = 0;
-              }
-            }
-            break;
-          }
-      case booltype:
-          {
-            i = 0;
-            j = 0;
-            for (k = 0; k < tx; k++) {
-              p = j * r + i;
-              store_bool(z, p, fetch_bool(x, k));
-              j++;
-              if (j == c) {
-                i++;
-                j = 0;
-              }
-            }
-            break;
-          }
-      case atype:
-          {
-            nialptr    *xp = pfirstitem(x);
-
-            i = 0;
-            j = 0;
-            for (k = 0; k < tx; k++) {
-              p = j * r + i;
-              store_array(z, p, xp[k]);
-              j++;
-              if (j == c) {
-                i++;
-                j = 0;
-              }
-            }
-            break;
-          }
-    }
+    /* item (i,j) of x at i*c+j moves to j*r+i in z */
+    movetiles(z, 0, 1, r, x, 0, c, 1, r, c);
     apush(z);
     freeup(x);
   }
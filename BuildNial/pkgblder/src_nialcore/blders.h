@@ -20,7 +20,7 @@ extern nialptr mkiquad(nialint i0, nialint i1, nialint i2, nialint i3);
 extern nialptr mkiquint(nialint i0, nialint i1, nialint i2, nialint i3, nialint i4);
 extern nialptr b_trform(nialptr sym, nialptr env, nialptr opargs, nialptr body);
 extern nialptr b_ifexpr(nialint cnt);
-extern nialptr b_caseexpr(nialptr ctest, nialptr selectvals, nialptr selectexprs, nialptr exprseqs);
+extern nialptr b_caseexpr(nialptr ctest, nialptr selectvals, nialptr selectexprs, nialptr exprseqs, nialptr cindex);
 extern nialptr b_blockbody(nialptr locallist, nialptr nonlocallist, nialptr defs, nialptr body);
 extern nialptr b_block(nialptr sym, nialptr cenv, int localcnt, nialptr body);
 extern nialptr b_opform(nialptr sym, nialptr cenv, int localcnt, nialptr arglist, nialptr body);
@@ -194,12 +194,29 @@ recur:
               }
             }
             else {
+              nialptr     argexp = get_argexpr(exp);
+
+              if (tally(argexp) == 3 &&
+                  (tag(argexp) == t_strand || tag(argexp) == t_list)) {
+                /* a call with a pair argument. The values are passed on
+                   the stack so that a binary opform can bind them directly */
 #ifdef EVAL_DEBUG
-              d_eval(get_argexpr(exp)); /* evaluate the opcall argument */
+                d_eval(fetch_array(argexp, 1));
+                d_eval(fetch_array(argexp, 2));
 #else
-              n_eval(get_argexpr(exp)); /* evaluate the opcall argument */
+                n_eval(fetch_array(argexp, 1));
+                n_eval(fetch_array(argexp, 2));
 #endif
-              apply(op);     /* apply the opcall optn */
+                applypair(op);
+              }
+              else {
+#ifdef EVAL_DEBUG
+                d_eval(argexp); /* evaluate the opcall argument */
+#else
+                n_eval(argexp); /* evaluate the opcall argument */
+#endif
+                apply(op);   /* apply the opcall optn */
+              }
             }
 #ifdef EVAL_DEBUG
             /* restore the onestep variable as we leave here if we saved it */
@@ -717,18 +734,40 @@ recur:
 #endif
             nialint     cnt,
                         i;
+            int         ranged = false;
+            nialptr     op,
+                        argexp;
 
             nialexitflag = false;
             idlist = get_idlist(exp);
             body = get_fexprseq(exp);
-            /* eval the with expression */
+            /* eval the with expression. For tell N or grid A of a list,
+               step through the addresses without forming them. */
+            if (!trace && forrangeop(get_expr(exp), &op, &argexp)) {
 #ifdef EVAL_DEBUG
-            d_eval(get_expr(exp));  
+              d_eval(argexp);
 #else
-            n_eval(get_expr(exp));  
+              n_eval(argexp);
 #endif
-            ival = apop();
-            cnt = tally(ival);
+              if (forrangecount(op, top, &cnt)) {
+                freeup(apop());
+                ival = Null;
+                ranged = true;
+              }
+              else
+                APPLYPRIMITIVE(op);
+            }
+            else {
+#ifdef EVAL_DEBUG
+              d_eval(get_expr(exp));  
+#else
+              n_eval(get_expr(exp));  
+#endif
+            }
+            if (!ranged) {
+              ival = apop();
+              cnt = tally(ival);
+            }
             apush(Nullexpr);
 #ifdef EVAL_DEBUG
             d_inloop = true;
@@ -736,7 +775,8 @@ recur:
             for (i = 0; i < cnt; i++) {
               /* free last value and assign variable */
               freeup(apop());
-              assign(idlist, fetchasarray(ival, i), false, false);
+              assign(idlist, (ranged ? createint(i) : fetchasarray(ival, i)),
+                     false, false);
 #ifdef EVAL_DEBUG
               d_eval(body);
 #else
@@ -799,15 +839,21 @@ recur:
             ca = get_svals(exp);
             /* find constant that corresponds to expr value    */
             /* if none, in = tally(ca) selects else case in expr_seq */
-            for (in = 0; !found && in < tally(ca); in++) {
-              labelList = fetchasarray(ca, in);
-              for (i = 0; !found && i < tally(labelList); i++)
-                found = equal(fetchasarray(labelList, i), val);
+            /* use the dispatch index if parse built one. A tree saved
+               in an older workspace has no index field. */
+            if (tally(exp) > 5 && get_cindex(exp) != Null)
+              in = caseselect(get_cindex(exp), ca, val);
+            else {
+              for (in = 0; !found && in < tally(ca); in++) {
+                labelList = fetchasarray(ca, in);
+                for (i = 0; !found && i < tally(labelList); i++)
+                  found = equal(fetchasarray(labelList, i), val);
+              }
+              if (found)
+                --in;        /* move in back to found case */
             }
             freeup(apop());  /* remove val */
             exprseqs = get_eseqs(exp);
-            if (found)
-              --in;          /* move in back to found case */
             body = fetch_array(exprseqs, in); /* pick up found case or else
                                                 expression (Nulltree if none) */
 #ifdef EVAL_DEBUG
@@ -842,11 +888,12 @@ recur:
             nialptr     save_env,
                         blockbdy = get_bdy(exp),
                         defs = get_defs(blockbdy);
-            nialint     nvars = get_cnt(exp);
+            nialint     nvars = get_cnt(exp),
+                        save_sp;
 
             nonlocs = get_nonlocallist(blockbdy); /* needed by lookup */
             /* set up new environment */
-            prologue(get_env(exp), nvars, &save_env); 
+            prologue(get_env(exp), nvars, &save_env, &save_sp);
             if (defs != grounded) {
 #ifdef EVAL_DEBUG
               d_eval(defs);
@@ -860,7 +907,7 @@ recur:
 #else
             n_eval(get_seq(blockbdy));
 #endif
-            epilogue(save_env, nvars);  /* restore environment */
+            epilogue(save_env, save_sp, nvars);  /* restore environment */
           }
           break;
 
@@ -126,6 +126,8 @@
 
 #define get_eseqs(x) fetch_array(x,4)
 
+#define get_cindex(x) fetch_array(x,5)
+
 #define get_dname(x) fetch_array(x,1)
 
 #define get_dvalue(x) fetch_array(x,2)
@@ -66,6 +66,10 @@ static void sdeepplace(nialptr entr, nialptr sym, nialptr path, nialptr val);
 static void splaceall(nialptr entr, nialptr sym, nialptr addrs, nialptr vals);
 static nialptr copy_array(nialptr a);
 static int  slice_addrs(nialptr a, nialptr addr);
+static int  slicearray(nialptr a, nialptr addr);
+static int  linearaddrs(nialptr a, nialptr addrs, nialptr * offsets);
+static void gather(nialptr z, nialptr a, nialptr offsets);
+static void scatter(nialptr a, nialptr offsets, nialptr vals);
 
 
 /* The routines below implement the Nial selection operations pick, choose
@@ -399,20 +403,182 @@ reach(nialptr a, nialptr path)
 }
 
 
+/* linearaddrs converts the addresses addrs of items of a into their
+   offsets in a, so that choose and placeall can move the items with the
+   typed loops of gather and scatter instead of a pick or place per item.
+   It handles integers addressing a list, and integer addresses with one
+   item per axis of a. The offsets are returned in an integer array, which
+   is addrs itself for the list case, so the caller frees it only if it
+   differs from addrs. It returns false, with nothing created, if any
+   address is of another form or out of range so that the general code
+   can handle it. */
+
+static int
+linearaddrs(nialptr a, nialptr addrs, nialptr * offsets)
+{
+  nialint     cnt = tally(addrs),
+              i,
+              k,
+              ix,
+              index,
+              extent;
+  nialptr     addr,
+              z;
+  int         va = valence(a);
+
+  if (va == 0 || atomic(addrs))
+    return (false);
+  if (va == 1 && kind(addrs) == inttype) {
+    for (i = 0; i < cnt; i++) {
+      ix = fetch_int(addrs, i);
+      if (ix < 0 || ix >= tally(a))
+        return (false);
+    }
+    *offsets = addrs;
+    return (true);
+  }
+  if (kind(addrs) != atype)
+    return (false);
+  for (i = 0; i < cnt; i++) {
+    addr = fetch_array(addrs, i);
+    if (kind(addr) != inttype || tally(addr) != va)
+      return (false);
+    for (k = 0; k < va; k++) {
+      ix = fetch_int(addr, k);
+      if (ix < 0 || ix >= pickshape(a, k))
+        return (false);
+    }
+  }
+  z = new_create_array(inttype, 1, 0, &cnt);
+  for (i = 0; i < cnt; i++) {
+    addr = fetch_array(addrs, i);
+    index = 0;
+    for (k = 0; k < va; k++) { /* Horner rule evaluation of the offset */
+      extent = pickshape(a, k);
+      index = index * extent + fetch_int(addr, k);
+    }
+    store_int(z, i, index);
+  }
+  *offsets = z;
+  return (true);
+}
+
+/* gather moves the items of a at offsets to z in order, and scatter
+   stores the items of vals into a at offsets in order, so a later
+   offset wins, as with a sequence of places. vals has the kind of a
+   and is either an atom, which is stored at every offset, or has one
+   item per offset. Both switch on the kind once and then loop over
+   typed pointers. No heap allocation is done. */
+
+static void
+gather(nialptr z, nialptr a, nialptr offsets)
+{
+  nialint     n = tally(offsets),
+             *op = pfirstint(offsets),
+              i;
+
+  switch (kind(a)) {
+    case inttype:
+        {
+          nialint    *zp = pfirstint(z),
+                     *ap = pfirstint(a);
+
+          for (i = 0; i < n; i++)
+            zp[i] = ap[op[i]];
+        }
+        break;
+    case realtype:
+        {
+          double     *zp = pfirstreal(z),
+                     *ap = pfirstreal(a);
+
+          for (i = 0; i < n; i++)
+            zp[i] = ap[op[i]];
+        }
+        break;
+    case chartype:
+        {
+          char       *zp = pfirstchar(z),
+                     *ap = pfirstchar(a);
+
+          for (i = 0; i < n; i++)
+            zp[i] = ap[op[i]];
+        }
+        break;
+    case booltype:
+        for (i = 0; i < n; i++)
+          store_bool(z, i, fetch_bool(a, op[i]));
+        break;
+    case atype:
+        {
+          nialptr    *ap = pfirstitem(a);
+
+          for (i = 0; i < n; i++)
+            store_array(z, i, ap[op[i]]);
+        }
+        break;
+  }
+}
+
+static void
+scatter(nialptr a, nialptr offsets, nialptr vals)
+{
+  nialint     n = tally(offsets),
+             *op = pfirstint(offsets),
+              s = (atomic(vals) ? 0 : 1),  /* step through vals */
+              i;
+
+  switch (kind(a)) {
+    case inttype:
+        {
+          nialint    *ap = pfirstint(a),
+                     *vp = pfirstint(vals);
+
+          for (i = 0; i < n; i++)
+            ap[op[i]] = vp[i * s];
+        }
+        break;
+    case realtype:
+        {
+          double     *ap = pfirstreal(a),
+                     *vp = pfirstreal(vals);
+
+          for (i = 0; i < n; i++)
+            ap[op[i]] = vp[i * s];
+        }
+        break;
+    case chartype:
+        {
+          char       *ap = pfirstchar(a),
+                     *vp = pfirstchar(vals);
+
+          for (i = 0; i < n; i++)
+            ap[op[i]] = vp[i * s];
+        }
+        break;
+    case booltype:
+        for (i = 0; i < n; i++)
+          store_bool(a, op[i], fetch_bool(vals, i * s));
+        break;
+  }
+}
+
 /* The internal routine to choose the items of a at addresses addrs.
    It is considerably faster than using the above definition.
    The result is an array of the same shape as addrs.
    It is used by ichoose and the indexed select routines.
    It returns false if one of the addrs is not valid.
    It frees a and addrs if they are temporary.
-   It uses pick to do the coercion and selection.
+   Addresses that linearaddrs can convert are moved by gather.
+   Otherwise it uses pick to do the coercion and selection.
 */
 
 int
 choose(nialptr a, nialptr addrs)
 {
   nialptr     z,
-              addri;
+              addri,
+              offsets;
   nialint     ta,
               addr,
               i;
@@ -424,10 +590,24 @@ choose(nialptr a, nialptr addrs)
 
     
 
+  v = valence(addrs);
+  if (v > 0 && kind(a) != phrasetype && kind(a) != faulttype &&
+      linearaddrs(a, addrs, &offsets)) {
+    z = new_create_array(kind(a), v, 0, shpptr(addrs, v));
+    gather(z, a, offsets);
+    if (offsets != addrs)
+      freeup(offsets);
+    if (kind(z) == atype && homotest(z))
+      z = implode(z);
+    apush(z);
+    freeup(addrs);
+    freeup(a);
+    return (true);
+  }
+
   apush(a);    /* protect a since pick might free it before we are
                   done using it. */
 
-  v = valence(addrs);
   ta = tally(a);
   
   /* There is special case code when a is a list and addrs is a list of 
@@ -661,8 +841,16 @@ place(nialptr a, nialptr addr, nialptr x, int *changed)
       *changed = true;
     }
     if (kind(a) == atype) {
+      /* a is not homogeneous before the update, so it can only become so
+         if x is an atom of a homotype replacing an item that is not an
+         atom of the same kind. Testing this first avoids a scan of all
+         of a on each update. */
+      nialptr     old = fetch_array(a, index);
+      int         mayimplode = homotype(kind(x)) && atomic(x) &&
+                               !(kind(old) == kind(x) && atomic(old));
+
       replace_array(a, index, x); /* update the array */
-      if (homotest(a)) {
+      if (mayimplode && homotest(a)) {
         apush(x);            /* protect x in case part of a */
         a = implode(a);
         *changed = true;
@@ -902,6 +1090,8 @@ iplaceall(void)
    for the result.
    If the result is in a container different from A, the variable changed is set.
    It is used by splaceall to avoid an unnecessary call to store_var.
+   When A is homogeneous, Vals are atoms of its kind and linearaddrs can
+   convert Addrs, the items are stored by scatter after unsharing A.
    */
 
 static int
@@ -909,7 +1099,8 @@ placeall(nialptr a, nialptr addrs, nialptr vals, int *changed)
 {
   nialptr     v1 = 0,
               addr,
-              val;
+              val,
+              offsets;
   nialint     cnt,
               i;
   int         v,
@@ -925,6 +1116,22 @@ placeall(nialptr a, nialptr addrs, nialptr vals, int *changed)
     freeup(vals);
     return (false);
   }
+  if (homotype(kind(a)) && kind(vals) == kind(a) && (v > 0 || atomic(vals)) &&
+      linearaddrs(a, addrs, &offsets)) {
+    if (!*changed && refcnt(a) > 1) {
+      /* force a copy to unshare an array with 2 or more refcnts */
+      a = copy_array(a);
+      *changed = true;
+    }
+    scatter(a, offsets, vals);
+    if (offsets != addrs)
+      freeup(offsets);
+    set_sorted(a, false);
+    apush(a);
+    freeup(addrs);
+    freeup(vals);
+    return (true);
+  }
   if (v == 0)
     /* pull out item of single to replicate */
   {
@@ -1236,6 +1443,10 @@ select1(nialptr exp)
           }
         }
 
+        /* select a slice of integer indices directly */
+        if (slicearray(a, addr))
+          break;
+
         /* use the general code to do a slice with choose */
         okay = slice_addrs(a, addr);
         if (!okay) {
@@ -1318,6 +1529,118 @@ slice_addrs(nialptr a, nialptr addr)
   return (true);
 }
 
+/* slicearray does the slice A|I directly when each item of the address
+   is an array of integers or Nullexpr for a whole axis, which covers
+   slices of rows, columns and blocks of any valence. The item of the
+   result at each position is taken from a at the sum of the axis indices
+   times the strides of a, so the addresses are not formed. When the last
+   axis is whole each sweep of it is moved as one run with copy.
+   It returns false, leaving the arguments alone, if the address is of
+   another form, selects a single item, or is out of range, so that the
+   general code handles those cases. */
+
+static int
+slicearray(nialptr a, nialptr addr)
+{
+  nialptr     ix,
+              shp,
+              strides,
+              counts,
+              z;
+  nialint     i,
+              j,
+              n,
+              p,
+              tz,
+              vz = 0,
+              offset,
+              limit;
+  int         va = valence(a),
+              k,
+              last = va - 1;
+
+  if (va == 0 || kind(addr) != atype || tally(addr) != va)
+    return (false);
+  for (k = 0; k < va; k++) {
+    ix = fetch_array(addr, k);
+    if (ix == Nullexpr)
+      vz++;
+    else {
+      if (kind(ix) != inttype)
+        return (false);
+      n = pickshape(a, k);
+      for (i = 0; i < tally(ix); i++) {
+        j = fetch_int(ix, i);
+        if (j < 0 || j >= n)
+          return (false);
+      }
+      vz += valence(ix);
+    }
+  }
+  if (vz == 0)
+    return (false);
+
+  /* the shape of the result is the link of the shapes of the indices */
+  shp = new_create_array(inttype, 1, 0, &vz);
+  for (k = 0, j = 0; k < va; k++) {
+    ix = fetch_array(addr, k);
+    if (ix == Nullexpr)
+      store_int(shp, j++, pickshape(a, k));
+    else
+      for (i = 0; i < valence(ix); i++)
+        store_int(shp, j++, pickshape(ix, i));
+  }
+  n = va;
+  strides = new_create_array(inttype, 1, 0, &n);
+  counts = new_create_array(inttype, 1, 0, &n);
+  store_int(strides, last, 1);
+  for (k = last - 1; k >= 0; k--)
+    store_int(strides, k, pickshape(a, k + 1) * fetch_int(strides, k + 1));
+  for (k = 0; k < va; k++)
+    store_int(counts, k, 0);
+  z = new_create_array(kind(a), vz, 0, pfirstint(shp));
+  tz = tally(z);
+
+  ix = fetch_array(addr, last);
+  limit = (ix == Nullexpr ? pickshape(a, last) : tally(ix));
+  for (i = 0; i < tz; i += limit) {
+    /* the offset of the sweep from the indices of the other axes */
+    offset = 0;
+    for (k = 0; k < last; k++) {
+      nialptr     ixk = fetch_array(addr, k);
+
+      p = fetch_int(counts, k);
+      offset += fetch_int(strides, k) * (ixk == Nullexpr ? p : fetch_int(ixk, p));
+    }
+    if (ix == Nullexpr)
+      copy(z, i, a, offset, limit);
+    else
+      for (p = 0; p < limit; p++)
+        copy1(z, i + p, a, offset + fetch_int(ix, p));
+
+    /* step the indices of the other axes */
+    for (k = last - 1; k >= 0; k--) {
+      nialptr     ixk = fetch_array(addr, k);
+
+      p = fetch_int(counts, k) + 1;
+      if (p < (ixk == Nullexpr ? pickshape(a, k) : tally(ixk))) {
+        store_int(counts, k, p);
+        break;
+      }
+      store_int(counts, k, 0);
+    }
+  }
+  freeup(shp);
+  freeup(strides);
+  freeup(counts);
+  if (kind(z) == atype && homotest(z))
+    z = implode(z);
+  apush(z);
+  freeup(addr);
+  freeup(a);
+  return (true);
+}
+
 /* insert does the evaluation work for insertion into an array
     using any of the four indexing notations: @, @@, # and |.
 
@@ -41,6 +41,8 @@ struct global_vars1 {
   int         g_EOFsignalled; /* for CTRL C stuff */
 
   nialint     g_initmemsize; /* initial memory size saved for a restart */
+  nialint     g_maxmemsize;  /* heap size that can be reached without moving */
+  nialint     g_compactlimit; /* fragmentation percentage that triggers compaction */
   jmp_buf     g_init_buf;    /* buffer for long jumps during startup */
   char        g_gcharbuf[GENBUFFERSIZE];  /* generic buffer to save space */
   int         g_keeplog;     /* on if log is being kept */
@@ -184,6 +186,8 @@ extern void signon(void);
 #define EOFsignalled G1.g_EOFsignalled
 #define loadfnm G1.g_loadfnm
 #define initmemsize G1.g_initmemsize
+#define maxmemsize G1.g_maxmemsize
+#define compactlimit G1.g_compactlimit
 #define init_buf G1.g_init_buf
 #define gcharbuf G1.g_gcharbuf
 #define keeplog G1.g_keeplog
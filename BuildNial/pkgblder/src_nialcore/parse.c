@@ -66,6 +66,7 @@
 #include "fileio.h"          /* for nprintf */
 #include "ops.h"             /* for append hitch */
 #include "if.h"              /* for checksignal */
+#include "compare.h"         /* for arrayhash, equalitem */
 
 
 
@@ -139,6 +140,7 @@ static nialint  FOR_EXPR(nialptr * tree);
 static nialint  IF_EXPR(nialptr * tree);
 static void ite_cleanup(int cnt);
 static nialint  CASE_EXPR(nialptr * tree);
+static nialptr caseindex(nialptr vals);
 
 /* the DEBUG version of error shows an error no so we can determine which call
    to error produced it, while the production version omits it.
@@ -3919,7 +3921,7 @@ CASE_EXPR(nialptr * tree)
     }
 
     accept1(); /* accept the ENDCASE, build the parse tree */
-    *tree = b_caseexpr(t1, clistvals, clist, slist);
+    *tree = b_caseexpr(t1, clistvals, clist, slist, caseindex(clistvals));
     return (SUCCEED);
   }
 
@@ -3932,6 +3934,111 @@ CASE_EXPR(nialptr * tree)
   return (ERROR);
 }
 
+/* caseindex builds the dispatch index for a CASE expression with the
+   selector values vals, a list holding the labels of each branch, so that
+   eval can select the branch without comparing the test value with each
+   label in turn. Integer labels spanning a small range get a dense index;
+   any other labels are hashed with arrayhash, which is consistent with
+   equal. A hashed slot holds a branch number, and a probe matches if any
+   label of that branch is equal to the value. A repeated label keeps its
+   first branch, as in the scan. Returns Null if there are too few labels
+   for an index to pay. See parse.h for the layout. */
+
+static int
+caselabel(nialptr vals, nialint g, nialptr x)
+{
+  nialptr     labels = fetch_array(vals, g);
+  nialint     i;
+
+  for (i = 0; i < tally(labels); i++)
+    if (equalitem(labels, i, x))
+      return (true);
+  return (false);
+}
+
+static      nialptr
+caseindex(nialptr vals)
+{
+  nialint     n = tally(vals),
+              cnt = 0,
+              lo,
+              hi,
+              v,
+              i,
+              j,
+              h,
+              g,
+              size,
+              mask;
+  nialptr     z,
+              labels;
+  int         dense = true;
+
+  lo = hi = 0;
+  for (i = 0; i < n; i++) {
+    labels = fetch_array(vals, i);
+    for (j = 0; j < tally(labels); j++) {
+      nialptr     x = fetchasarray(labels, j);
+
+      if (kind(x) != inttype || !atomic(x))
+        dense = false;
+      else {
+        v = intval(x);
+        if (cnt == 0 || v < lo)
+          lo = v;
+        if (cnt == 0 || v > hi)
+          hi = v;
+      }
+      cnt++;
+      freeup(x);
+    }
+  }
+  if (cnt < CASEINDEXMIN)
+    return (Null);
+  if (dense && (unialint) hi - (unialint) lo < (unialint) (2 * cnt + 8)) {
+    size = hi - lo + 3;
+    z = new_create_array(inttype, 1, 0, &size);
+    store_int(z, 0, CASEDENSE);
+    store_int(z, 1, lo);
+    for (i = 2; i < size; i++)
+      store_int(z, i, n);    /* selects the ELSE branch */
+    for (i = n - 1; i >= 0; i--) {  /* in reverse so the first one wins */
+      labels = fetch_array(vals, i);
+      for (j = 0; j < tally(labels); j++) {
+        nialptr     x = fetchasarray(labels, j);
+
+        store_int(z, intval(x) - lo + 2, i);
+        freeup(x);
+      }
+    }
+    return (z);
+  }
+  size = 16;
+  while (size < 2 * cnt)
+    size *= 2;
+  mask = size - 1;
+  size += 2;
+  z = new_create_array(inttype, 1, 0, &size);
+  store_int(z, 0, CASEHASH);
+  store_int(z, 1, mask);
+  for (i = 2; i < size; i++)
+    store_int(z, i, -1);
+  for (i = 0; i < n; i++) {
+    labels = fetch_array(vals, i);
+    for (j = 0; j < tally(labels); j++) {
+      nialptr     x = fetchasarray(labels, j);
+
+      h = arrayhash(x) & mask;
+      while ((g = fetch_int(z, h + 2)) >= 0 && g != i && !caselabel(vals, g, x))
+        h = (h + 1) & mask;
+      if (g < 0)
+        store_int(z, h + 2, i);
+      freeup(x);
+    }
+  }
+  return (z);
+}
+
 /* a comment is a "%" followed by text up unyil a ";".
    It is scanned as a single token. 
 */
@@ -40,6 +40,7 @@
 
 /* MATHLIB */
 #include <math.h>
+#include <float.h>
 
 
 /* Q'Nial header files */
@@ -55,9 +56,11 @@
 #include "lexical.h"         /* for BLANK */
 #include "fileio.h"          /* for nprintf */
 #include "if.h"              /* for checksignal */
+#include "utils.h"           /* for scan_number */
 
 
 static int  realtochar(double x, char *buf);
+static int  inttochar(nialint n, char *buf);
 static int  disp(nialptr x, int displaymode);
 static nialptr paste(nialptr x, int vpad, int hpad, int vlines, int hlines, nialptr vjust, nialptr hjust, int emptysw);
 static void pospaste(nialptr x, int vpad, int hpad, int vlines, int hlines);
@@ -206,6 +209,264 @@ isetformat()
   freeup(z);
 }
 
+/* Fast formatting of reals.
+   Most reals are written with the default "%g" format or with a simple
+   setformat string such as '%.3g' or '%.2f', and sprintf dominates the
+   time to picture or write a large real array. For those formats the
+   digits are computed directly: the number is scaled by an exact power
+   of ten in long double arithmetic and rounded. The scaled value carries
+   at least 63 bits, so the rounding is right unless the value is within
+   its error bound of a half, in which case sprintf is used to settle it.
+   Any other format, and zero, infinities and tiny or huge numbers, go to
+   sprintf as before. The result is the same text that sprintf gives.
+
+   display uses the shortest of the 15, 16 and 17 digit forms that reads
+   back as the same number, instead of always using 17 digits.
+*/
+
+#if LDBL_MANT_DIG >= 64
+#define FASTREALS
+#endif
+
+static char fastsrc[FORMAT_LEN] = "%g"; /* format last classified */
+static int  fastkind = 'g';  /* 'g', 'f' or 0 for sprintf */
+static int  fastprec = 6;
+static int  roundtrip = false; /* set by idisplay */
+
+#define MAXPOW10 27          /* 10^27 is exact in a 64 bit mantissa */
+
+static long double lpow10[MAXPOW10 + 1] = {
+  1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L, 1e10L,
+  1e11L, 1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L, 1e20L,
+  1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L};
+
+/* decide whether stdformat is one the fast path handles */
+
+static void
+classify_format(void)
+{
+  char       *f = stdformat;
+  int         prec = -1;
+
+  strcpy(fastsrc, stdformat);
+  fastkind = 0;
+  if (*f++ != '%')
+    return;
+  if (*f == '.') {
+    f++;
+    prec = 0;
+    while (*f >= '0' && *f <= '9' && prec < 100)
+      prec = prec * 10 + (*f++ - '0');
+  }
+  if ((*f != 'g' && *f != 'f') || f[1] != '\0')
+    return;
+  if (*f == 'g') {
+    prec = (prec < 0 ? 6 : prec == 0 ? 1 : prec);
+    if (prec > 17)
+      return;
+  }
+  else {
+    prec = (prec < 0 ? 6 : prec);
+    if (prec > 17)
+      return;
+  }
+  fastkind = *f;
+  fastprec = prec;
+}
+
+/* round |x| * 10^k to an integer. Returns false if the scaled value is out
+   of range or too close to a half to round with certainty. */
+
+static int
+scaledround(double x, int k, unsigned long long *d)
+{
+#ifdef FASTREALS
+  long double v,
+              fl,
+              fr;
+
+  if (k > MAXPOW10 || k < -MAXPOW10)
+    return (false);
+  v = (k >= 0 ? (long double) x * lpow10[k] : (long double) x / lpow10[-k]);
+  if (v >= 1e18L)
+    return (false);
+  fl = floorl(v);
+  fr = v - fl;
+  if (fabsl(fr - 0.5L) <= v * LDBL_EPSILON)
+    return (false);
+  *d = (unsigned long long) fl + (fr > 0.5L);
+  return (true);
+#else
+  return (false);
+#endif
+}
+
+/* get the prec significant digits of |x| > 0 and the decimal exponent
+   of the first one */
+
+static int
+sigdigits(double x, int prec, unsigned long long *d, int *exp10)
+{
+  int         e = (int) floor(log10(x));
+  unsigned long long lo = (unsigned long long) lpow10[prec - 1],
+              hi = (unsigned long long) lpow10[prec];
+
+  if (!scaledround(x, prec - 1 - e, d))
+    return (false);
+  /* log10 can be off by one next to a power of ten. A result of lo can
+     also come from a value just below 10^e rounding up, so it is
+     redone one place lower and kept there unless it rounds up to hi. */
+  if (*d <= lo) {
+    e--;
+    if (!scaledround(x, prec - 1 - e, d))
+      return (false);
+  }
+  else if (*d > hi) {
+    e++;
+    if (!scaledround(x, prec - 1 - e, d))
+      return (false);
+  }
+  if (*d == hi) {            /* rounded up to the next power of ten */
+    *d = lo;
+    e++;
+  }
+  if (*d < lo || *d >= hi)
+    return (false);
+  *exp10 = e;
+  return (true);
+}
+
+/* put the n digit decimal form of d into buf, returns the end */
+
+static char *
+putdigits(char *buf, unsigned long long d, int n)
+{
+  int         i;
+
+  for (i = n - 1; i >= 0; i--) {
+    buf[i] = (char) ('0' + d % 10);
+    d /= 10;
+  }
+  return (buf + n);
+}
+
+/* format x > 0 as "%.<prec>g" would. Returns false if not handled. */
+
+static int
+fastg(double x, int prec, char *buf)
+{
+  unsigned long long d;
+  int         e;
+  char        digs[20],
+             *p = buf,
+             *q;
+  int         n;
+
+  if (!sigdigits(x, prec, &d, &e))
+    return (false);
+  putdigits(digs, d, prec);
+  n = prec;
+  while (n > 1 && digs[n - 1] == '0') /* %g drops trailing zeros */
+    n--;
+  if (e < -4 || e >= prec) { /* exponent form */
+    *p++ = digs[0];
+    if (n > 1) {
+      *p++ = '.';
+      memcpy(p, digs + 1, n - 1);
+      p += n - 1;
+    }
+    *p++ = 'e';
+    *p++ = (e < 0 ? '-' : '+');
+    if (e < 0)
+      e = -e;
+    if (e >= 100)
+      *p++ = (char) ('0' + e / 100);
+    *p++ = (char) ('0' + (e / 10) % 10);
+    *p++ = (char) ('0' + e % 10);
+  }
+  else if (e >= 0) {
+    memcpy(p, digs, e + 1 < n ? e + 1 : n);
+    p += (e + 1 < n ? e + 1 : n);
+    for (q = digs + n; q < digs + e + 1; q++)
+      *p++ = '0';
+    if (n > e + 1) {
+      *p++ = '.';
+      memcpy(p, digs + e + 1, n - e - 1);
+      p += n - e - 1;
+    }
+  }
+  else {
+    *p++ = '0';
+    *p++ = '.';
+    for (e = -e - 1; e > 0; e--)
+      *p++ = '0';
+    memcpy(p, digs, n);
+    p += n;
+  }
+  *p = '\0';
+  return (true);
+}
+
+/* format x > 0 as "%.<prec>f" would. Returns false if not handled. */
+
+static int
+fastf(double x, int prec, char *buf)
+{
+  unsigned long long d,
+              ip;
+  char       *p = buf;
+  int         n = 1;
+
+  if (!scaledround(x, prec, &d))
+    return (false);
+  ip = d / (unsigned long long) lpow10[prec];
+  while (n < 19 && ip >= (unsigned long long) lpow10[n])
+    n++;
+  p = putdigits(p, ip, n);
+  if (prec > 0) {
+    *p++ = '.';
+    p = putdigits(p, d % (unsigned long long) lpow10[prec], prec);
+  }
+  *p = '\0';
+  return (true);
+}
+
+/* format x in the shortest of 15, 16 and 17 digits that reads back as x */
+
+static void
+shortestreal(double x, char *buf)
+{
+  int         prec;
+  nialint     ival;
+  double      rval;
+  char       *s = buf;
+
+  if (x != x || x == 0. || x - x != 0.) {
+    sprintf(buf, "%.17g", x);
+    return;
+  }
+  if (x < 0.) {
+    *s++ = '-';
+    x = -x;
+  }
+  for (prec = 15; prec < 17; prec++) {
+    if (!fastg(x, prec, s))
+      sprintf(s, "%.*g", prec, x);
+    switch (scan_number(s, strlen(s), &ival, &rval)) {
+      case 1:
+          if ((double) ival == x)
+            return;
+          break;
+      case 2:
+          if (rval == x)
+            return;
+          break;
+    }
+  }
+  if (!fastg(x, 17, s))
+    sprintf(s, "%.17g", x);
+}
+
 /* routine to convert a real number to its character string representation */
 
 static int
@@ -213,9 +474,29 @@ realtochar(double x, char *buf)
 {
   int         i,
               n,
-              found = false;
+              found = false,
+              done = false;
 
-  sprintf(buf, stdformat, x);/* format given the C format */
+  if (roundtrip) {
+    shortestreal(x, buf);
+    done = true;
+  }
+  else {
+    if (strcmp(fastsrc, stdformat) != 0)
+      classify_format();
+    if (fastkind != 0 && x != 0. && x - x == 0.) { /* finite and non zero */
+      char       *s = buf;
+      double      ax = x;
+
+      if (x < 0.) {
+        *s++ = '-';
+        ax = -x;
+      }
+      done = (fastkind == 'g' ? fastg(ax, fastprec, s) : fastf(ax, fastprec, s));
+    }
+  }
+  if (!done)
+    sprintf(buf, stdformat, x);/* format given the C format */
   n = strlen(buf);
     /* correct for funny in sprintf. Sometimes it has - sign */
   if (x == 0.)              
@@ -236,6 +517,29 @@ realtochar(double x, char *buf)
   return (strlen(buf));
 }
 
+/* routine to convert an integer to its character string representation
+   without going through sprintf */
+
+static int
+inttochar(nialint n, char *buf)
+{
+  char        tmp[NDINT + 1],
+             *p = tmp + NDINT;
+  unsigned long long u = (n < 0 ? 0ULL - (unsigned long long) n : (unsigned long long) n);
+  int         len;
+
+  do {
+    *--p = (char) ('0' + u % 10);
+    u /= 10;
+  } while (u != 0);
+  if (n < 0)
+    *--p = '-';
+  len = (int) (tmp + NDINT - p);
+  memcpy(buf, p, len);
+  buf[len] = '\0';
+  return (len);
+}
+
 
 /* isketch implements the primitive operation sketch which produces
    a character table that pictures the array with some detail omitted.
@@ -436,6 +740,7 @@ idisplay()
 
   /* set stdformat to display full real numbers and turn off decor */
   strcpy(stdformat, FULLREALFORMAT);
+  roundtrip = true;
   decor = false;
 
   ptrCbuffer = startCbuffer; /* used by disp to gather the string */
@@ -456,11 +761,84 @@ idisplay()
   
  /* restore global real format settings and decor setting */
   strcpy(stdformat, svdformat);
+  roundtrip = false;
   decor = svdecor;
 
   apush(z); /* push the result */
 }
 
+/* inumstring implements the operation numstring which renders the numbers
+   of a simple array as one string, using the current real format. The
+   argument is the array or a pair of the array and a separator character;
+   the default separator is a blank. It is the fast way to prepare a
+   column of numbers for writing to a file. */
+
+void
+inumstring()
+{
+  nialptr     x = apop(),
+              a,
+              z;
+  nialint     i,
+              tx,
+              sz;
+  char        sep = BLANK;
+  int         kx;
+
+  a = x;
+  if (kind(x) == atype && tally(x) == 2 && kind(fetch_array(x, 1)) == chartype
+      && atomic(fetch_array(x, 1))) {
+    a = fetch_array(x, 0);
+    sep = charval(fetch_array(x, 1));
+  }
+  kx = kind(a);
+  tx = tally(a);
+  if (kx == atype) {
+    for (i = 0; i < tx; i++) {
+      nialptr     it = fetch_array(a, i);
+
+      if (!atomic(it) || !numeric(kind(it))) {
+        freeup(x);
+        buildfault("numstring arg is not simple and numeric");
+        return;
+      }
+    }
+  }
+  else if (!numeric(kx)) {
+    freeup(x);
+    buildfault("numstring arg is not simple and numeric");
+    return;
+  }
+
+  ptrCbuffer = startCbuffer;
+  for (i = 0; i < tx; i++) {
+    nialptr     it = (kx == atype ? fetch_array(a, i) : a);
+    nialint     j = (kx == atype ? 0 : i);
+
+    reservechars(NDREAL + 2);
+    if (i > 0)
+      *ptrCbuffer++ = sep;
+    switch (kind(it)) {
+      case booltype:
+          *ptrCbuffer++ = (fetch_bool(it, j) ? 'l' : 'o');
+          break;
+      case inttype:
+          ptrCbuffer += inttochar(fetch_int(it, j), ptrCbuffer);
+          break;
+      case realtype:
+          ptrCbuffer += realtochar(fetch_real(it, j), ptrCbuffer);
+          break;
+    }
+  }
+  sz = ptrCbuffer - startCbuffer;
+  freeup(x);
+
+  z = new_create_array(chartype, 1, 0, &sz);
+  memcpy(pfirstchar(z), startCbuffer, sz); /* safe, no allocation */
+  *(pfirstchar(z) + sz) = '\0';
+  apush(z);
+}
+
 #define ENDCHARS " ()[]{}#,;"
 
 
@@ -657,10 +1035,10 @@ disp(nialptr x, int displaymode)
             char        buf[NDINT + 1];
             nialint     intlen;
 
-            sprintf(buf, NIALINT_FORMAT, (nialint_format_type)fetch_int(x, i));
+            intlen = inttochar(fetch_int(x, i), buf);
             reservechars(NDINT + 1);
             strcpy(ptrCbuffer, buf);
-            ptrCbuffer += (intlen = strlen(buf));
+            ptrCbuffer += intlen;
             dsz += intlen;
             pushch(BLANK); /* add blank as separator */
             dsz++;
@@ -22,6 +22,12 @@
 
 #define dfmemsize  32000000    /* default workspace size in units */
 
+#ifdef INTS64
+#define dfmaxmemsize 16000000000L  /* default address space reserved for the heap */
+#else
+#define dfmaxmemsize 256000000
+#endif
+
 #define minmemsize (dfatomtblsize * 4 + 20000)
 
 
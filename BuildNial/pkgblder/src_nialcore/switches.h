@@ -47,6 +47,9 @@ the code of Q'Nial is processed.
 #define JOBCONTROL
 #define FP_EXCEPTION_FLAG
 #define USER_BREAK_FLAG
+#ifdef UNIXSYS
+#define RESERVEDHEAP     /* heap grows in place in a reserved address range */
+#endif
 
 /* define these four switches below to trade speed for space */
 
@@ -1154,7 +1154,10 @@ sort(nialptr f, nialptr x, int gradesw)
     L = pfirstint(l);        /* safe: reloaded below */
     L[0] = 1;
     t = n + 1;
-    if (n >= 2) {
+    if (n >= 2 && f == upcode && kx == atype && stringsort(x, L, n)) {
+      /* a list of strings sorted on normalised keys has set the links */
+    }
+    else if (n >= 2) {
       /* loop over pairs of adjacent items comparing them */
       for (p = 1; p < n; p++) {
         if (lteflag) { /* use C comparator on atomic types, "up" on arrays */
@@ -2488,6 +2491,13 @@ BYKEY is TR f OP A B {
            EACHLEFT choose (Indices choose B)) }
 */
 
+/* When f is sum, max or min and B is a numeric list, the aggregates are
+   computed in one pass over hashed classes of A by groupaggregate, without
+   sorting A or forming the collections. The classes are in the order of
+   cull A and the items of each are combined in their order in B, so the
+   results are those of the general code. An integer overflow is left to
+   the general code. */
+
 void
 ibykey()
 {
@@ -2513,6 +2523,22 @@ ibykey()
 
   /* split the data arg into a and b and protect a */
   splitfb(x, &a, &b);
+
+  if (tag(f) == t_basic && (f == sumcode || f == maxcode || f == mincode) &&
+      valence(a) == 1 && tally(a) > 0) {
+    int         mode = (f == sumcode ? GROUPSUM : f == maxcode ? GROUPMAX : GROUPMIN);
+
+    if (kind(b) != booltype && groupaggregate(a, b, mode, &keys, &z)) {
+      freeup(keys);
+      if (kind(z) != atype) {
+        freeup(x);
+        apush(z);
+        return;
+      }
+      freeup(z);             /* an integer sum overflowed, use the general code */
+    }
+  }
+
   apush(a);                  /* to protect a for below */
 
   /* get the gradeup of a */
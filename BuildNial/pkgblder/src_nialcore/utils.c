@@ -492,3 +492,135 @@ slower(char *in_s)
   out_s[cnt] = '\0';
   return (out_s);
 }
+
+/* routine to convert the text of a plain decimal number without going
+   through the scanner. It accepts an optional minus sign, digits with an
+   optional fraction and an optional exponent with a - or + sign, with
+   blanks allowed on either side. The result is 1 with *ival set for an
+   integer, 2 with *rval set for a real, and 0 for any other text,
+   including an integer too large for the machine, so that the caller can
+   fall back to the scanner. The value is the same as the one produced
+   by the scanner: mantissas that fit in 53 bits with small exponents
+   are converted exactly here, the rest are passed on to strtod which
+   is correctly rounded.  Used by tonumber and tonumbers. */
+
+static double pow10tab[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+#define numblank(c) ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n')
+
+int
+scan_number(char *s, nialint len, nialint * ival, double *rval)
+{
+  nialint     i = 0,
+              start,
+              end = len;
+  unsigned long long m = 0;
+  int         neg = 0,
+              isreal = 0,
+              ndigits = 0,
+              nsig = 0,
+              exp10 = 0,
+              lost = 0;
+
+  while (i < end && numblank(s[i]))
+    i++;
+  while (end > i && numblank(s[end - 1]))
+    end--;
+  start = i;
+  if (i < end && s[i] == '-') {
+    neg = 1;
+    i++;
+  }
+  /* integer part, then fraction. Up to 19 significant digits are kept in
+     m, further digits only adjust the exponent. */
+  while (i < end && isdigit((unsigned char) s[i])) {
+    if (nsig < 19) {
+      m = m * 10 + (s[i] - '0');
+      if (m != 0)
+        nsig++;
+    }
+    else {
+      exp10++;
+      if (s[i] != '0')
+        lost = 1;
+    }
+    ndigits++;
+    i++;
+  }
+  if (i < end && s[i] == '.') {
+    isreal = 1;
+    i++;
+    while (i < end && isdigit((unsigned char) s[i])) {
+      if (nsig < 19) {
+        m = m * 10 + (s[i] - '0');
+        if (m != 0)
+          nsig++;
+        exp10--;
+      }
+      else if (s[i] != '0')
+        lost = 1;
+      ndigits++;
+      i++;
+    }
+  }
+  if (ndigits == 0)
+    return (0);
+  if (i < end && (s[i] == 'e' || s[i] == 'E')) {
+    int         eneg = 0,
+                edigits = 0,
+                e = 0;
+
+    isreal = 1;
+    i++;
+    if (i < end && (s[i] == '-' || s[i] == '+')) {
+      eneg = s[i] == '-';
+      i++;
+    }
+    while (i < end && isdigit((unsigned char) s[i])) {
+      if (e < 100000)
+        e = e * 10 + (s[i] - '0');
+      edigits++;
+      i++;
+    }
+    if (edigits == 0)
+      return (0);
+    exp10 += eneg ? -e : e;
+  }
+  if (i != end)
+    return (0);
+
+  if (!isreal) {
+    if (lost || exp10 != 0 || m > (unsigned long long) LARGEINT) {
+#ifdef INTS32
+      /* the scanner makes a real of an integer that does not fit */
+      isreal = 1;
+#else
+      return (0);
+#endif
+    }
+    else {
+      *ival = neg ? -(nialint) m : (nialint) m;
+      return (1);
+    }
+  }
+
+  if (!lost && m <= (1ULL << 53) && exp10 >= -22 && exp10 <= 22) {
+    double      r = (double) m;
+
+    r = exp10 < 0 ? r / pow10tab[-exp10] : r * pow10tab[exp10];
+    *rval = neg ? -r : r;
+  }
+  else {
+    char        buf[512];
+    nialint     n = end - start;
+
+    if (n >= (nialint) sizeof(buf))
+      return (0);
+    memcpy(buf, s + start, n);
+    buf[n] = '\0';
+    *rval = strtod(buf, NULL);
+  }
+  return (2);
+}
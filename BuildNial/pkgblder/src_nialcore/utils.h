@@ -21,3 +21,4 @@ extern void cnvtup(char *str);
 extern nialint ngetname(nialptr x, char *value);
 extern nialptr getuppername(void);
 extern char *slower(char *in_s);
+extern int  scan_number(char *s, nialint len, nialint * ival, double *rval);